@@ -37,6 +37,17 @@ static char                 *capture_device = "alsa_input.platform-sound.stereo-
 
 static pa_stream            *monitor_stm = NULL;
 
+/*
+ * Playback wakeups from PulseAudio callbacks, instead of polling. Callbacks take
+ * play_mux on the mainloop thread, so threads in audio_play*() must not be
+ * canceled: stop them with audio_play_cancel() and join
+ */
+
+static pthread_mutex_t      play_mux = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t       play_cond = PTHREAD_COND_INITIALIZER;
+static uint32_t             play_event = 0;
+static uint32_t             play_cancel = 0;
+
 static void record_monitor_setup();
 
 static void on_state_change(pa_context *c, void *userdata) {
@@ -51,6 +62,48 @@ static void read_callback(pa_stream *s, size_t nbytes, void *udata) {
     pa_stream_drop(s);
 }
 
+static void play_signal() {
+    pthread_mutex_lock(&play_mux);
+    play_event++;
+    pthread_cond_broadcast(&play_cond);
+    pthread_mutex_unlock(&play_mux);
+}
+
+static void write_callback(pa_stream *s, size_t nbytes, void *udata) {
+    play_signal();
+}
+
+static void drain_callback(pa_stream *s, int success, void *udata) {
+    play_signal();
+}
+
+static void play_snapshot(uint32_t *event, uint32_t *cancel) {
+    pthread_mutex_lock(&play_mux);
+    *event = play_event;
+    *cancel = play_cancel;
+    pthread_mutex_unlock(&play_mux);
+}
+
+/**
+ * Sleep until a callback after the event snapshot. Returns false if playback was canceled
+ */
+static bool play_wait(uint32_t *event, uint32_t cancel) {
+    bool res;
+
+    pthread_mutex_lock(&play_mux);
+
+    while (*event == play_event && cancel == play_cancel) {
+        pthread_cond_wait(&play_cond, &play_mux);
+    }
+
+    *event = play_event;
+    res = cancel == play_cancel;
+
+    pthread_mutex_unlock(&play_mux);
+
+    return res;
+}
+
 static void mixer_setup() {
     int res;
     // overall level
@@ -109,6 +162,7 @@ void audio_init() {
     play_stm = pa_stream_new(ctx, "X6100 GUI Play", &spec, NULL);
 
     pa_threaded_mainloop_lock(mloop);
+    pa_stream_set_write_callback(play_stm, write_callback, NULL);
     pa_stream_connect_playback(play_stm, play_device, &attr, PA_STREAM_ADJUST_LATENCY, NULL, NULL);
     pa_threaded_mainloop_unlock(mloop);
 
@@ -127,71 +181,106 @@ void audio_init() {
     record_monitor_setup();
 }
 
+/**
+ * Queue samples, sleeping while the stream buffer (tlength) is full.
+ * Returns -1 if playback was canceled or failed
+ */
 int audio_play(int16_t *samples_buf, size_t samples) {
-    while (true) {
-        size_t size;
+    const uint8_t   *ptr = (const uint8_t *) samples_buf;
+    size_t          left = samples * 2;
+    uint32_t        event, cancel;
+
+    play_snapshot(&event, &cancel);
+
+    while (left) {
+        int     res = 0;
+        size_t  size;
 
         pa_threaded_mainloop_lock(mloop);
         size = pa_stream_writable_size(play_stm);
+
+        if (size == (size_t) -1) {
+            res = -1;
+        } else {
+            size = LV_MIN(size, left) & ~1;
+
+            if (size) {
+                res = pa_stream_write(play_stm, ptr, size, NULL, 0, PA_SEEK_RELATIVE);
+            }
+        }
         pa_threaded_mainloop_unlock(mloop);
 
-        if (size >= (samples * 2)) {
-            break;
+        if (res < 0) {
+            LV_LOG_ERROR("pa_stream_write() failed: %s", pa_strerror(pa_context_errno(ctx)));
+            return res;
         }
 
-        usleep(1000);
-    }
+        ptr += size;
+        left -= size;
 
-    pa_threaded_mainloop_lock(mloop);
-    int res = pa_stream_write(play_stm, samples_buf, samples * 2, NULL, 0, PA_SEEK_RELATIVE);
-    pa_threaded_mainloop_unlock(mloop);
-
-    if (res < 0) {
-        LV_LOG_ERROR("pa_stream_write() failed: %s", pa_strerror(pa_context_errno(ctx)));
+        if (left && !play_wait(&event, cancel)) {
+            return -1;
+        }
     }
 
-    return res;
+    return 0;
 }
 
+/**
+ * Sleep until queued samples are played or playback is canceled
+ */
 void audio_play_wait() {
-    pa_operation *op;
-    int r;
+    pa_operation    *op;
+    uint32_t        event, cancel;
+
+    play_snapshot(&event, &cancel);
 
     pa_threaded_mainloop_lock(mloop);
-    op = pa_stream_drain(play_stm, NULL, NULL);
+    op = pa_stream_drain(play_stm, drain_callback, NULL);
     pa_threaded_mainloop_unlock(mloop);
 
+    if (!op) {
+        return;
+    }
+
     while (true) {
         pa_threaded_mainloop_lock(mloop);
-        r = pa_operation_get_state(op);
+        int r = pa_operation_get_state(op);
         pa_threaded_mainloop_unlock(mloop);
 
         if (r == PA_OPERATION_DONE || r == PA_OPERATION_CANCELLED) {
             break;
         }
 
-        usleep(1000);
+        if (!play_wait(&event, cancel)) {
+            pa_threaded_mainloop_lock(mloop);
+            pa_operation_cancel(op);
+            pa_threaded_mainloop_unlock(mloop);
+            break;
+        }
     }
 
+    pa_threaded_mainloop_lock(mloop);
     pa_operation_unref(op);
+    pa_threaded_mainloop_unlock(mloop);
 }
 
-void audio_gain_db(int16_t *buf, size_t samples, float gain, int16_t *out) {
-    float scale = exp10f(gain / 10.0f);
-
-    for (uint16_t i = 0; i < samples; i++) {
-        int32_t x = buf[i] * scale;
-
-        if (x > 32767) {
-            x = 32767;
-        }
+/**
+ * Drop queued samples and wake up audio_play() and audio_play_wait() sleeping now
+ */
+void audio_play_cancel() {
+    pthread_mutex_lock(&play_mux);
+    play_cancel++;
+    pthread_cond_broadcast(&play_cond);
+    pthread_mutex_unlock(&play_mux);
 
-        if (x < -32767) {
-            x = -32767;
-        }
+    pa_threaded_mainloop_lock(mloop);
+    pa_operation *op = pa_stream_flush(play_stm, NULL, NULL);
 
-        out[i] = x;
+    if (op) {
+        pa_operation_unref(op);
     }
+    pa_threaded_mainloop_unlock(mloop);
 }
 
 void audio_play_en(bool on) {
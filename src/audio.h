@@ -17,6 +17,5 @@
 void audio_init();
 int audio_play(int16_t *buf, size_t samples);
 void audio_play_wait();
+void audio_play_cancel();
 void audio_play_en(bool on);
-
-void audio_gain_db(int16_t *buf, size_t samples, float gain, int16_t *out);
@@ -0,0 +1,200 @@
+/*
+ *  SPDX-License-Identifier: LGPL-2.1-or-later
+ *
+ *  Xiegu X6100 LVGL GUI
+ *
+ *  Copyright (c) 2022-2023 Belousov Oleg aka R1CBU
+ */
+
+#include "audio_ring.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include <stdatomic.h>
+
+#include "lvgl/lvgl.h"
+
+struct audio_ring_s {
+    float complex   *buf;       /* size + guard */
+    uint32_t        size;       /* Power of 2 */
+    uint32_t        guard;      /* Max contiguous read and write */
+    atomic_uint     head;       /* Published samples, wraps around */
+
+    pthread_mutex_t mux;
+    pthread_cond_t  cond;
+};
+
+struct audio_ring_reader_s {
+    audio_ring_t    ring;
+    const char      *name;
+    uint32_t        tail;
+    uint32_t        max_lag;
+    uint32_t        overruns;
+    uint32_t        lost;
+};
+
+audio_ring_t audio_ring_create(size_t size, size_t guard) {
+    audio_ring_t ring = calloc(1, sizeof(struct audio_ring_s));
+
+    ring->buf = calloc(size + guard, sizeof(float complex));
+    ring->size = size;
+    ring->guard = guard;
+    atomic_init(&ring->head, 0);
+
+    pthread_mutex_init(&ring->mux, NULL);
+
+    pthread_condattr_t attr;
+
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&ring->cond, &attr);
+    pthread_condattr_destroy(&attr);
+
+    return ring;
+}
+
+void audio_ring_destroy(audio_ring_t ring) {
+    pthread_cond_destroy(&ring->cond);
+    pthread_mutex_destroy(&ring->mux);
+    free(ring->buf);
+    free(ring);
+}
+
+/**
+ * Space to write up to n samples in place. Returns count, it may be less than n
+ */
+size_t audio_ring_reserve(audio_ring_t ring, float complex **ptr, size_t n) {
+    uint32_t pos = atomic_load_explicit(&ring->head, memory_order_relaxed) & (ring->size - 1);
+
+    n = LV_MIN(n, ring->size - pos);
+    n = LV_MIN(n, ring->guard);
+
+    *ptr = ring->buf + pos;
+
+    return n;
+}
+
+/**
+ * Publish n reserved samples and wake up consumers
+ */
+void audio_ring_commit(audio_ring_t ring, size_t n) {
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    uint32_t pos = head & (ring->size - 1);
+
+    if (pos < ring->guard) {
+        memcpy(ring->buf + ring->size + pos, ring->buf + pos, LV_MIN(n, ring->guard - pos) * sizeof(float complex));
+    }
+
+    atomic_store_explicit(&ring->head, head + n, memory_order_release);
+
+    pthread_mutex_lock(&ring->mux);
+    pthread_cond_broadcast(&ring->cond);
+    pthread_mutex_unlock(&ring->mux);
+}
+
+/**
+ * New consumer, it starts from the next published samples
+ */
+audio_ring_reader_t audio_ring_reader_create(audio_ring_t ring, const char *name) {
+    audio_ring_reader_t reader = calloc(1, sizeof(struct audio_ring_reader_s));
+
+    reader->ring = ring;
+    reader->name = name;
+    reader->tail = atomic_load_explicit(&ring->head, memory_order_acquire);
+
+    return reader;
+}
+
+void audio_ring_reader_destroy(audio_ring_reader_t reader) {
+    free(reader);
+}
+
+/**
+ * Contiguous unread samples, up to max (and guard). They stay valid until audio_ring_release()
+ */
+size_t audio_ring_peek(audio_ring_reader_t reader, float complex **ptr, size_t max) {
+    audio_ring_t    ring = reader->ring;
+    uint32_t        head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    uint32_t        lag = head - reader->tail;
+    uint32_t        limit = ring->size - ring->guard;
+
+    if (lag > limit) {
+        LV_LOG_WARN("%s lost %u samples", reader->name, lag - limit);
+
+        reader->overruns++;
+        reader->lost += lag - limit;
+        reader->tail = head - limit;
+        lag = limit;
+    }
+
+    if (lag > reader->max_lag) {
+        reader->max_lag = lag;
+    }
+
+    *ptr = ring->buf + (reader->tail & (ring->size - 1));
+
+    return LV_MIN(LV_MIN(lag, max), ring->guard);
+}
+
+/**
+ * Done with n samples. Counts an overrun, if the producer could overwrite them during use
+ */
+void audio_ring_release(audio_ring_reader_t reader, size_t n) {
+    audio_ring_t    ring = reader->ring;
+    uint32_t        head = atomic_load_explicit(&ring->head, memory_order_acquire);
+
+    if (head - reader->tail > ring->size - ring->guard) {
+        reader->overruns++;
+    }
+
+    reader->tail += n;
+}
+
+/**
+ * Sleep until n samples are unread or timeout. Returns true if they are
+ */
+bool audio_ring_wait(audio_ring_reader_t reader, size_t n, uint32_t timeout_ms) {
+    audio_ring_t    ring = reader->ring;
+    struct timespec deadline;
+    bool            res;
+
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+
+    deadline.tv_sec += timeout_ms / 1000;
+    deadline.tv_nsec += (timeout_ms % 1000) * 1000000L;
+
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+
+    pthread_mutex_lock(&ring->mux);
+
+    while (true) {
+        res = atomic_load_explicit(&ring->head, memory_order_acquire) - reader->tail >= n;
+
+        if (res || pthread_cond_timedwait(&ring->cond, &ring->mux, &deadline) != 0) {
+            break;
+        }
+    }
+
+    pthread_mutex_unlock(&ring->mux);
+
+    return res;
+}
+
+/**
+ * Drop all unread samples, without counting them as lost
+ */
+void audio_ring_skip(audio_ring_reader_t reader) {
+    reader->tail = atomic_load_explicit(&reader->ring->head, memory_order_acquire);
+}
+
+void audio_ring_stats(audio_ring_reader_t reader, audio_ring_stats_t *stats) {
+    stats->lag = atomic_load_explicit(&reader->ring->head, memory_order_acquire) - reader->tail;
+    stats->max_lag = reader->max_lag;
+    stats->overruns = reader->overruns;
+    stats->lost = reader->lost;
+}
@@ -0,0 +1,55 @@
+/*
+ *  SPDX-License-Identifier: LGPL-2.1-or-later
+ *
+ *  Xiegu X6100 LVGL GUI
+ *
+ *  Copyright (c) 2022-2023 Belousov Oleg aka R1CBU
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <complex.h>
+
+/*
+ * Single producer, many consumers audio ring. The producer writes samples in
+ * place and publishes them, every consumer reads at its own pace by index,
+ * straight from the ring. A consumer falling behind more than the ring size
+ * loses the oldest samples, only it and nobody else. The first guard samples
+ * are mirrored after the end, so up to guard samples are always contiguous.
+ *
+ * audio_ring_wait() shares a mutex with the producer, which runs on the
+ * PulseAudio callback. Consumer threads must not be canceled, stop them with
+ * a flag checked after every wait timeout and join.
+ */
+
+typedef struct audio_ring_s * audio_ring_t;
+typedef struct audio_ring_reader_s * audio_ring_reader_t;
+
+typedef struct {
+    uint32_t    lag;        /* Samples not read yet */
+    uint32_t    max_lag;
+    uint32_t    overruns;   /* Times samples were lost */
+    uint32_t    lost;       /* Samples lost */
+} audio_ring_stats_t;
+
+audio_ring_t audio_ring_create(size_t size, size_t guard);
+void audio_ring_destroy(audio_ring_t ring);
+
+/* Producer side */
+
+size_t audio_ring_reserve(audio_ring_t ring, float complex **ptr, size_t n);
+void audio_ring_commit(audio_ring_t ring, size_t n);
+
+/* Consumer side */
+
+audio_ring_reader_t audio_ring_reader_create(audio_ring_t ring, const char *name);
+void audio_ring_reader_destroy(audio_ring_reader_t reader);
+
+size_t audio_ring_peek(audio_ring_reader_t reader, float complex **ptr, size_t max);
+void audio_ring_release(audio_ring_reader_t reader, size_t n);
+bool audio_ring_wait(audio_ring_reader_t reader, size_t n, uint32_t timeout_ms);
+void audio_ring_skip(audio_ring_reader_t reader);
+void audio_ring_stats(audio_ring_reader_t reader, audio_ring_stats_t *stats);
@@ -0,0 +1,253 @@
+/*
+ *  SPDX-License-Identifier: LGPL-2.1-or-later
+ *
+ *  Xiegu X6100 LVGL GUI
+ *
+ *  Copyright (c) 2022-2023 Belousov Oleg aka R1CBU
+ */
+
+/*
+ * Benchmark of the CW decoder character lookup against the string scan.
+ * Exits with error if the decoded characters differ.
+ *
+ * cw_bench [-n lookups] [-w wpm]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "../cw_decoder.h"
+
+#define LONGEST     (CW_MORSE_MAX + 2)
+#define SEQS        4096
+#define STEP_MS     5.0f
+
+typedef struct {
+    uint8_t len;
+    bool    dah[LONGEST];
+} seq_t;
+
+static seq_t                seqs[SEQS];
+static char                 decoded[4096];
+static volatile uintptr_t   sink;
+
+static uint64_t now_ns() {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint64_t) now.tv_sec * 1000000000L + now.tv_nsec;
+}
+
+/* Decoder output */
+
+void pannel_add_text(const char * text) {
+    size_t len = strlen(decoded);
+
+    if (len + strlen(text) < sizeof(decoded)) {
+        strcpy(decoded + len, text);
+    }
+}
+
+/* Old cw_decoder_dict(), as reference */
+
+static const char * dict_reference(const char *elements) {
+    cw_characters_t *character = &cw_characters[0];
+
+    while (character->morse) {
+        if (strcmp(elements, character->morse) == 0) {
+            return character->character;
+        }
+
+        character++;
+    }
+
+    return NULL;
+}
+
+static const char * lookup_packed(const bool *dah, uint8_t len) {
+    uint16_t code = CW_MORSE_EMPTY;
+
+    for (uint8_t i = 0; i < len; i++) {
+        code = cw_morse_push(code, dah[i]);
+    }
+
+    return cw_morse_lookup(code);
+}
+
+static const char * lookup_reference(const bool *dah, uint8_t len) {
+    char elements[LONGEST + 1] = "";
+
+    for (uint8_t i = 0; i < len; i++) {
+        strcat(elements, dah[i] ? "-" : ".");
+    }
+
+    return dict_reference(elements);
+}
+
+/* Every element string up to LONGEST elements */
+
+static int check_lookup() {
+    bool dah[LONGEST];
+
+    for (uint8_t len = 1; len <= LONGEST; len++) {
+        for (uint32_t bits = 0; bits < (1u << len); bits++) {
+            for (uint8_t i = 0; i < len; i++) {
+                dah[i] = (bits >> (len - 1 - i)) & 1;
+            }
+
+            const char *a = lookup_packed(dah, len);
+            const char *b = lookup_reference(dah, len);
+
+            if ((a == NULL) != (b == NULL) || (a && strcmp(a, b) != 0)) {
+                fprintf(stderr, "lookup mismatch at length %u code %X: %s != %s\n",
+                        len, bits, a ? a : "<?>", b ? b : "<?>");
+                return 1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+/* Key every table entry through cw_decoder_signal() with ideal timing */
+
+static void key(bool on, uint32_t ms) {
+    for (uint32_t t = 0; t < ms; t += STEP_MS) {
+        cw_decoder_signal(on, STEP_MS);
+    }
+}
+
+static void key_morse(const char *morse, uint32_t dit) {
+    for (const char *c = morse; *c; c++) {
+        key(true, *c == '-' ? dit * 3 : dit);
+        key(false, dit);
+    }
+
+    key(false, dit * 2);
+}
+
+static int check_decode(uint32_t wpm) {
+    uint32_t    dit = 1200 / wpm;
+    char        expected[sizeof(decoded)] = "";
+
+    /* Let the dot/dash threshold settle on the speed first */
+
+    for (uint8_t i = 0; i < 4; i++) {
+        key_morse(".-", dit);
+    }
+
+    key(false, dit * 20);
+    decoded[0] = 0;
+
+    for (cw_characters_t *character = &cw_characters[0]; character->morse; character++) {
+        key_morse(character->morse, dit);
+
+        const char *ref = dict_reference(character->morse);
+
+        strcat(expected, ref ? ref : "<?>");
+    }
+
+    key(false, dit * 20);
+    strcat(expected, " ");
+
+    if (strcmp(decoded, expected) != 0) {
+        fprintf(stderr, "decode mismatch at %u wpm:\n  %s\n  %s\n", wpm, decoded, expected);
+        return 1;
+    }
+
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    uint32_t    lookups = 1000000;
+    uint32_t    wpm = 20;
+    int         opt;
+
+    while ((opt = getopt(argc, argv, "n:w:")) != -1) {
+        switch (opt) {
+            case 'n':
+                lookups = atoi(optarg);
+                break;
+
+            case 'w':
+                wpm = atoi(optarg);
+                break;
+
+            default:
+                fprintf(stderr, "Usage: %s [-n lookups] [-w wpm]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    if (wpm < 5 || wpm > 40) {
+        fprintf(stderr, "wpm out of 5..40\n");
+        return 1;
+    }
+
+    cw_decoder_init();
+
+    if (check_lookup() || check_decode(wpm)) {
+        return 1;
+    }
+
+    /* Mostly table characters, some unknown and too long codes */
+
+    srand(1);
+
+    uint32_t entries = 0;
+
+    while (cw_characters[entries].morse) {
+        entries++;
+    }
+
+    for (uint32_t i = 0; i < SEQS; i++) {
+        seq_t *seq = &seqs[i];
+
+        if (rand() % 8) {
+            const char *morse = cw_characters[rand() % entries].morse;
+
+            seq->len = strlen(morse);
+
+            for (uint8_t k = 0; k < seq->len; k++) {
+                seq->dah[k] = morse[k] == '-';
+            }
+        } else {
+            seq->len = 1 + rand() % LONGEST;
+
+            for (uint8_t k = 0; k < seq->len; k++) {
+                seq->dah[k] = rand() & 1;
+            }
+        }
+    }
+
+    uint64_t start = now_ns();
+
+    for (uint32_t i = 0; i < lookups; i++) {
+        seq_t *seq = &seqs[i % SEQS];
+
+        sink = (uintptr_t) lookup_reference(seq->dah, seq->len);
+    }
+
+    uint64_t reference_ns = now_ns() - start;
+
+    start = now_ns();
+
+    for (uint32_t i = 0; i < lookups; i++) {
+        seq_t *seq = &seqs[i % SEQS];
+
+        sink = (uintptr_t) lookup_packed(seq->dah, seq->len);
+    }
+
+    uint64_t packed_ns = now_ns() - start;
+
+    printf("lookups:          %u\n", lookups);
+    printf("string scan:      %8.1f ns/char\n", (double) reference_ns / lookups);
+    printf("packed code:      %8.1f ns/char (%.1fx)\n", (double) packed_ns / lookups, (double) reference_ns / packed_ns);
+
+    return 0;
+}
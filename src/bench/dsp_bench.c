@@ -0,0 +1,222 @@
+/*
+ *  SPDX-License-Identifier: LGPL-2.1-or-later
+ *
+ *  Xiegu X6100 LVGL GUI
+ *
+ *  Copyright (c) 2022-2023 Belousov Oleg aka R1CBU
+ */
+
+/*
+ * Headless benchmark of the RX pipeline: feeds synthetic or recorded IQ
+ * through dsp_samples() and prints per-stage cost.
+ *
+ * dsp_bench [-n frames] [-z spectrum_factor] [-f capture.cf32]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <math.h>
+
+#include "../dsp.h"
+#include "../radio.h"
+#include "../iq_replay.h"
+
+#define WARMUP_FRAMES   100
+#define SYNTH_FRAMES    256
+#define FRAME_USEC      ((uint64_t) RADIO_SAMPLES * 1000000L / IQ_REPLAY_RATE)
+
+/* Virtual clock: dsp.c paces spectrum/waterfall by get_time(), linked with --wrap=get_time */
+
+static uint64_t         virtual_usec = 0;
+
+uint64_t __wrap_get_time() {
+    return virtual_usec / 1000;
+}
+
+/* Allocation counter, on top of glibc allocator */
+
+extern void * __libc_malloc(size_t size);
+extern void * __libc_calloc(size_t n, size_t size);
+extern void * __libc_realloc(void *ptr, size_t size);
+extern void __libc_free(void *ptr);
+
+static bool             count_allocs = false;
+static uint64_t         allocs = 0;
+static uint64_t         frees = 0;
+
+void * malloc(size_t size) {
+    if (count_allocs) allocs++;
+    return __libc_malloc(size);
+}
+
+void * calloc(size_t n, size_t size) {
+    if (count_allocs) allocs++;
+    return __libc_calloc(n, size);
+}
+
+void * realloc(void *ptr, size_t size) {
+    if (count_allocs) allocs++;
+    return __libc_realloc(ptr, size);
+}
+
+void free(void *ptr) {
+    if (count_allocs && ptr) frees++;
+    __libc_free(ptr);
+}
+
+/* Synthetic IQ: noise floor, a few carriers and a slow sweep */
+
+static float complex    synth_buf[RADIO_SAMPLES];
+static float            synth_phase[4];
+static uint32_t         synth_seed = 1;
+
+static float synth_noise() {
+    synth_seed = synth_seed * 1664525u + 1013904223u;
+    return ((float) (synth_seed >> 8) / (1 << 24) - 0.5f) * 2e-5f;
+}
+
+static float complex * synth_frame(uint32_t n) {
+    const float freq[3] = { -0.31f, 0.012f, 0.27f };
+    const float ampl[3] = { 1e-3f, 3e-2f, 1e-4f };
+    float       sweep = 0.45f * sinf(n * 0.001f);
+
+    for (uint16_t i = 0; i < RADIO_SAMPLES; i++) {
+        float complex x = synth_noise() + I * synth_noise();
+
+        for (uint8_t k = 0; k < 3; k++) {
+            x += ampl[k] * cexpf(I * synth_phase[k]);
+            synth_phase[k] = fmodf(synth_phase[k] + 2.0f * M_PI * freq[k], 2.0f * M_PI);
+        }
+
+        x += 1e-3f * cexpf(I * synth_phase[3]);
+        synth_phase[3] = fmodf(synth_phase[3] + 2.0f * M_PI * sweep, 2.0f * M_PI);
+
+        synth_buf[i] = x;
+    }
+
+    return synth_buf;
+}
+
+static uint64_t now_ns() {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint64_t) now.tv_sec * 1000000000L + now.tv_nsec;
+}
+
+int main(int argc, char *argv[]) {
+    uint32_t    frames = 20000;
+    uint8_t     factor = 1;
+    const char  *path = NULL;
+    int         opt;
+
+    while ((opt = getopt(argc, argv, "n:z:f:")) != -1) {
+        switch (opt) {
+            case 'n':
+                frames = atoi(optarg);
+                break;
+
+            case 'z':
+                factor = atoi(optarg);
+                break;
+
+            case 'f':
+                path = optarg;
+                break;
+
+            default:
+                fprintf(stderr, "Usage: %s [-n frames] [-z spectrum_factor] [-f capture.cf32]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    iq_replay_t replay = NULL;
+
+    if (path) {
+        replay = iq_replay_open(path);
+
+        if (!replay) {
+            fprintf(stderr, "Can't open %s\n", path);
+            return 1;
+        }
+    }
+
+    dsp_init(factor);
+
+    /* Pre-generate synthetic frames, so generator cost is out of the loop */
+
+    float complex *synth = NULL;
+
+    if (!replay) {
+        synth = malloc(SYNTH_FRAMES * sizeof(synth_buf));
+
+        for (uint32_t n = 0; n < SYNTH_FRAMES; n++) {
+            memcpy(synth + n * RADIO_SAMPLES, synth_frame(n), sizeof(synth_buf));
+        }
+    }
+
+    for (uint32_t n = 0; n < WARMUP_FRAMES; n++) {
+        float complex *frame = replay ? iq_replay_next(replay) : synth + (n % SYNTH_FRAMES) * RADIO_SAMPLES;
+
+        dsp_samples(frame, RADIO_SAMPLES, false);
+        virtual_usec += FRAME_USEC;
+    }
+
+    dsp_stats_reset();
+
+    uint64_t total_ns = 0;
+
+    count_allocs = true;
+
+    for (uint32_t n = 0; n < frames; n++) {
+        float complex *frame = replay ? iq_replay_next(replay) : synth + (n % SYNTH_FRAMES) * RADIO_SAMPLES;
+        uint64_t start = now_ns();
+
+        dsp_samples(frame, RADIO_SAMPLES, false);
+
+        total_ns += now_ns() - start;
+        virtual_usec += FRAME_USEC;
+    }
+
+    count_allocs = false;
+
+    dsp_stage_stat_t stats[DSP_STAGE_LAST];
+
+    dsp_stats_get(stats);
+
+    printf("source:       %s\n", path ? path : "synthetic");
+    printf("frames:       %u x %u samples, spectrum factor %u\n", frames, RADIO_SAMPLES, factor);
+    printf("total:        %.0f ns/frame, %.0f frames/s (%.1fx realtime)\n",
+        (double) total_ns / frames,
+        frames * 1e9 / total_ns,
+        (double) frames * FRAME_USEC * 1000 / total_ns
+    );
+    printf("allocations:  %llu malloc, %llu free (%.2f/frame)\n\n",
+        (unsigned long long) allocs, (unsigned long long) frees, (double) allocs / frames
+    );
+
+    printf("%-16s %10s %12s %12s\n", "stage", "calls", "ns/call", "ns/frame");
+
+    for (uint8_t i = 0; i < DSP_STAGE_LAST; i++) {
+        double per_call = stats[i].calls ? (double) stats[i].ns / stats[i].calls : 0.0;
+
+        printf("%-16s %10u %12.0f %12.0f\n",
+            dsp_stage_name(i), stats[i].calls, per_call, (double) stats[i].ns / frames
+        );
+    }
+
+    dsp_demod_stop();
+
+    if (replay) {
+        iq_replay_close(replay);
+    }
+    free(synth);
+
+    return 0;
+}
@@ -0,0 +1,81 @@
+/*
+ *  SPDX-License-Identifier: LGPL-2.1-or-later
+ *
+ *  Xiegu X6100 LVGL GUI
+ *
+ *  Copyright (c) 2022-2023 Belousov Oleg aka R1CBU
+ */
+
+/* UI and radio side of dsp.c, replaced by sinks for headless benchmark */
+
+#include <string.h>
+
+#include "../dsp.h"
+#include "../radio.h"
+#include "../spectrum.h"
+#include "../waterfall.h"
+#include "../meter.h"
+#include "../rtty.h"
+#include "../recorder.h"
+#include "../dialog.h"
+#include "../dialog_msg_voice.h"
+#include "../backlight.h"
+
+static float    spectrum_sink[SPECTRUM_NFFT];
+static float    waterfall_sink[WATERFALL_NFFT];
+
+void spectrum_data(float *data_buf, uint16_t size, bool tx) {
+    memcpy(spectrum_sink, data_buf, size * sizeof(float));
+}
+
+void waterfall_data(float *data_buf, uint16_t size, bool tx) {
+    memcpy(waterfall_sink, data_buf, size * sizeof(float));
+}
+
+void spectrum_update_max(float db) {
+}
+
+void spectrum_update_min(float db) {
+}
+
+void waterfall_update_max(float db) {
+}
+
+void waterfall_update_min(float db) {
+}
+
+void meter_update(int16_t db, float beta) {
+}
+
+void radio_filter_get(int32_t *from_freq, int32_t *to_freq) {
+    *from_freq = 50;
+    *to_freq = 2950;
+}
+
+x6100_mode_t radio_current_mode() {
+    return x6100_mode_usb;
+}
+
+msg_voice_state_t dialog_msg_voice_get_state() {
+    return MSG_VOICE_OFF;
+}
+
+void dialog_msg_voice_put_audio_samples(size_t nsamples, int16_t *samples) {
+}
+
+rtty_state_t rtty_get_state() {
+    return RTTY_OFF;
+}
+
+void rtty_put_audio_samples(unsigned int n, float complex *samples) {
+}
+
+void cw_put_audio_samples(unsigned int n, float complex *samples) {
+}
+
+void dialog_audio_samples(unsigned int n, float complex *samples) {
+}
+
+bool backlight_is_on() {
+    return true;
+}
@@ -0,0 +1,412 @@
+/*
+ *  SPDX-License-Identifier: LGPL-2.1-or-later
+ *
+ *  Xiegu X6100 LVGL GUI
+ *
+ *  Copyright (c) 2022-2023 Belousov Oleg aka R1CBU
+ */
+
+/*
+ * Offline FT8/FT4 decoder of WAV slot recordings, for sensitivity and speed
+ * regression of the decoder on a corpus. Audio goes the way of dialog_ft8:
+ * Hilbert transform, decimation by 4 (for 44.1/48 kHz files), ft8_wf
+ * waterfall, then the same ft8_slot decoding as the radio: passes of sync
+ * search, LDPC decoding and subtraction, and the OSD fallback.
+ *
+ * Each file is one slot starting at the slot boundary (like WSJT-X saves them),
+ * 16 bit PCM or 32 bit float, mono or the first channel.
+ *
+ * -e decodes early after each block like the radio does with early decoding on,
+ * -t gives the slot decoding a deadline of ms after the waterfall is full
+ * (none by default, so the decodes do not depend on the machine speed),
+ * the radio has about 1000 ms for FT8 and 500 ms for FT4.
+ * -r quantizes the waterfall with log10f() instead of the table, -c builds
+ * both waterfalls and checks they are the same (so the decodes are too).
+ *
+ * ft8_bench [-4] [-p passes] [-o osd_depth] [-e] [-t ms] [-r] [-c] [-v] file.wav|dir ...
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <strings.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <math.h>
+#include <liquid/liquid.h>
+
+#include "../ft8/decode.h"
+#include "../ft8_pool.h"
+#include "../ft8_wf.h"
+#include "../ft8_slot.h"
+#include "../hilbert.h"
+#include "../util.h"
+
+#define DECIM           4
+
+static ftx_protocol_t   protocol = PROTO_FT8;
+static int              max_passes = FT8_SLOT_PASSES;
+static int              osd_depth = FT8_SLOT_OSD_DEPTH;
+static bool             early = false;
+static uint32_t         budget_ms = 0;
+static bool             verbose = false;
+static bool             reference = false;
+static bool             check = false;
+
+static uint64_t         wf_ns = 0;
+static uint64_t         slot_ns[FT8_SLOT_STAGE_LAST];
+static uint32_t         total_slots = 0;
+static uint32_t         total_decoded = 0;
+static uint32_t         total_passes = 0;
+static uint64_t         total_ns = 0;
+static uint64_t         total_mismatch = 0;
+static uint16_t         num_decoded;
+
+static uint64_t now_ns() {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint64_t) now.tv_sec * 1000000000L + now.tv_nsec;
+}
+
+static uint32_t read_u32(const uint8_t *p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+static uint16_t read_u16(const uint8_t *p) {
+    return p[0] | (p[1] << 8);
+}
+
+/**
+ * Samples of the first channel, scaled to +-1.0. Returns NULL for unsupported file
+ */
+static float * load_wav(const char *name, uint32_t *rate, size_t *count) {
+    FILE        *f = fopen(name, "rb");
+    uint8_t     hdr[12];
+    uint16_t    format = 0, channels = 0, bits = 0;
+    float       *samples = NULL;
+
+    if (!f) {
+        return NULL;
+    }
+
+    if (fread(hdr, 1, 12, f) != 12 || memcmp(hdr, "RIFF", 4) != 0 || memcmp(hdr + 8, "WAVE", 4) != 0) {
+        fclose(f);
+        return NULL;
+    }
+
+    while (fread(hdr, 1, 8, f) == 8) {
+        uint32_t size = read_u32(hdr + 4);
+
+        if (memcmp(hdr, "fmt ", 4) == 0 && size >= 16) {
+            uint8_t fmt[16];
+
+            if (fread(fmt, 1, 16, f) != 16) {
+                break;
+            }
+
+            format = read_u16(fmt);
+            channels = read_u16(fmt + 2);
+            *rate = read_u32(fmt + 4);
+            bits = read_u16(fmt + 14);
+
+            fseek(f, size - 16 + (size & 1), SEEK_CUR);
+        } else if (memcmp(hdr, "data", 4) == 0) {
+            bool pcm16 = format == 1 && bits == 16;
+            bool float32 = format == 3 && bits == 32;
+
+            if (channels == 0 || (!pcm16 && !float32)) {
+                break;
+            }
+
+            size_t  frame = channels * bits / 8;
+            size_t  n = size / frame;
+            uint8_t *raw = malloc(n * frame);
+
+            n = fread(raw, frame, n, f);
+            samples = malloc(n * sizeof(float));
+
+            for (size_t i = 0; i < n; i++) {
+                const uint8_t *p = raw + i * frame;
+
+                if (pcm16) {
+                    samples[i] = (int16_t) read_u16(p) / 32768.0f;
+                } else {
+                    memcpy(&samples[i], p, sizeof(float));
+                }
+            }
+
+            free(raw);
+            *count = n;
+            break;
+        } else {
+            fseek(f, size + (size & 1), SEEK_CUR);
+        }
+    }
+
+    fclose(f);
+
+    return samples;
+}
+
+static void decoded_cb(const ft8_job_t *job, void *user) {
+    const waterfall_t *wf = user;
+
+    num_decoded++;
+
+    if (!verbose) {
+        return;
+    }
+
+    float symbol_period = protocol == PROTO_FT4 ? FT4_SYMBOL_PERIOD : FT8_SYMBOL_PERIOD;
+    float dt = (job->cand.time_offset + (float) job->cand.time_sub / wf->time_osr) * symbol_period - 0.5f;
+    float freq = (job->cand.freq_offset + (float) job->cand.freq_sub / wf->freq_osr) / symbol_period;
+
+    printf("  %+4i dB %+5.1f s %6.1f Hz %s%s\n", job->cand.snr, dt, freq, job->message.text,
+        job->osd_depth ? " (osd)" : "");
+}
+
+static void decode_file(const char *name) {
+    uint32_t    rate = 0;
+    size_t      count = 0;
+    float       *samples = load_wav(name, &rate, &count);
+
+    if (!samples) {
+        fprintf(stderr, "%s: not a PCM16/float WAV\n", name);
+        return;
+    }
+
+    uint8_t     decim = rate > 24000 ? DECIM : 1;
+    uint32_t    sample_rate = rate / decim;
+
+    if (sample_rate < 8000 || sample_rate > 16000) {
+        fprintf(stderr, "%s: unsupported rate %u\n", name, rate);
+        free(samples);
+        return;
+    }
+
+    uint64_t        start = now_ns();
+    ft8_wf_t        ft8_wf = ft8_wf_create(protocol, sample_rate, FT8_SLOT_TIME_OSR, FT8_SLOT_FREQ_OSR);
+    waterfall_t     *wf = ft8_wf_waterfall(ft8_wf);
+    ft8_slot_t      slot = ft8_slot_create(ft8_wf, decoded_cb, wf);
+    uint32_t        block_size = ft8_wf_block_size(ft8_wf);
+    ft8_wf_t        check_wf = NULL;
+    hilbert_t       hilb = hilbert_create(7, 60.0f);
+    firdecim_crcf   fir = decim > 1 ? firdecim_crcf_create_kaiser(decim, 16, 40.0f) : NULL;
+    float complex   *audio = malloc(block_size * decim * sizeof(float complex));
+    float complex   *block = malloc(block_size * sizeof(float complex));
+
+    ft8_wf_set_reference(ft8_wf, reference);
+
+    if (check) {
+        check_wf = ft8_wf_create(protocol, sample_rate, FT8_SLOT_TIME_OSR, FT8_SLOT_FREQ_OSR);
+        ft8_wf_set_reference(check_wf, !reference);
+    }
+
+    num_decoded = 0;
+
+    if (verbose) {
+        printf("%s\n", name);
+    }
+
+    for (size_t pos = 0; pos + block_size * decim <= count; pos += block_size * decim) {
+        hilbert_execute(hilb, samples + pos, block_size * decim, audio);
+
+        if (fir) {
+            firdecim_crcf_execute_block(fir, audio, block_size, block);
+        } else {
+            memcpy(block, audio, block_size * sizeof(float complex));
+        }
+
+        if (!ft8_wf_process(ft8_wf, block)) {
+            break;
+        }
+
+        if (check_wf) {
+            ft8_wf_process(check_wf, block);
+        }
+
+        if (early && wf->num_blocks < wf->max_blocks) {
+            ft8_slot_early(slot);
+        }
+    }
+
+    if (check_wf) {
+        const waterfall_t   *other = ft8_wf_waterfall(check_wf);
+        uint32_t            mismatch = 0;
+
+        for (int i = 0; i < wf->num_blocks * wf->block_stride; i++) {
+            mismatch += wf->mag[i] != other->mag[i];
+        }
+
+        if (mismatch) {
+            fprintf(stderr, "%s: %u waterfall cells differ\n", name, mismatch);
+        }
+
+        total_mismatch += mismatch;
+        ft8_wf_destroy(check_wf);
+    }
+
+    /* Early decoding is counted in the waterfall time, as the radio does it while the slot goes on */
+
+    wf_ns += now_ns() - start;
+
+    uint8_t passes = ft8_slot_decode(slot, budget_ms ? get_time() + budget_ms : 0, max_passes, osd_depth);
+
+    uint64_t    ns = now_ns() - start;
+    uint64_t    stats[FT8_SLOT_STAGE_LAST];
+
+    ft8_slot_stats_get(slot, stats);
+
+    for (int i = 0; i < FT8_SLOT_STAGE_LAST; i++) {
+        slot_ns[i] += stats[i];
+    }
+
+    printf("%-40s %3u decoded %u passes %8.1f ms\n", name, num_decoded, passes, ns / 1e6);
+
+    total_slots++;
+    total_decoded += num_decoded;
+    total_passes += passes;
+    total_ns += ns;
+
+    free(audio);
+    free(block);
+    hilbert_destroy(hilb);
+
+    if (fir) {
+        firdecim_crcf_destroy(fir);
+    }
+
+    ft8_slot_destroy(slot);
+    ft8_wf_destroy(ft8_wf);
+    free(samples);
+}
+
+static int cmp_names(const void *a, const void *b) {
+    return strcmp(*(char * const *) a, *(char * const *) b);
+}
+
+/**
+ * WAV files of the directory, in name order
+ */
+static void decode_dir(const char *path) {
+    DIR             *dir = opendir(path);
+    struct dirent   *entry;
+    char            **names = NULL;
+    size_t          n = 0;
+
+    if (!dir) {
+        fprintf(stderr, "Can't open %s\n", path);
+        return;
+    }
+
+    while ((entry = readdir(dir)) != NULL) {
+        size_t len = strlen(entry->d_name);
+
+        if (len < 4 || strcasecmp(entry->d_name + len - 4, ".wav") != 0) {
+            continue;
+        }
+
+        names = realloc(names, (n + 1) * sizeof(char *));
+        names[n] = malloc(strlen(path) + len + 2);
+        sprintf(names[n], "%s/%s", path, entry->d_name);
+        n++;
+    }
+
+    closedir(dir);
+    qsort(names, n, sizeof(char *), cmp_names);
+
+    for (size_t i = 0; i < n; i++) {
+        decode_file(names[i]);
+        free(names[i]);
+    }
+
+    free(names);
+}
+
+int main(int argc, char *argv[]) {
+    int opt;
+
+    while ((opt = getopt(argc, argv, "4p:o:et:rcv")) != -1) {
+        switch (opt) {
+            case '4':
+                protocol = PROTO_FT4;
+                break;
+
+            case 'p':
+                max_passes = atoi(optarg);
+                break;
+
+            case 'o':
+                osd_depth = atoi(optarg);
+                break;
+
+            case 'e':
+                early = true;
+                break;
+
+            case 't':
+                budget_ms = atoi(optarg);
+                break;
+
+            case 'r':
+                reference = true;
+                break;
+
+            case 'c':
+                check = true;
+                break;
+
+            case 'v':
+                verbose = true;
+                break;
+
+            default:
+                fprintf(stderr, "Usage: %s [-4] [-p passes] [-o osd_depth] [-e] [-t ms] [-r] [-c] [-v] file.wav|dir ...\n", argv[0]);
+                return 1;
+        }
+    }
+
+    if (optind == argc || max_passes < 1 || osd_depth < 0 || osd_depth > 2) {
+        fprintf(stderr, "Usage: %s [-4] [-p passes] [-o osd_depth] [-e] [-t ms] [-r] [-c] [-v] file.wav|dir ...\n", argv[0]);
+        return 1;
+    }
+
+    ft8_pool_init();
+
+    for (int i = optind; i < argc; i++) {
+        struct stat st;
+
+        if (stat(argv[i], &st) == 0 && S_ISDIR(st.st_mode)) {
+            decode_dir(argv[i]);
+        } else {
+            decode_file(argv[i]);
+        }
+    }
+
+    if (total_slots == 0) {
+        return 1;
+    }
+
+    printf("\n%u slots, %.2f decoded/slot, %.2f passes/slot, %.1f ms/slot wall, %u threads\n\n",
+        total_slots, (float) total_decoded / total_slots, (float) total_passes / total_slots,
+        total_ns / 1e6 / total_slots, ft8_pool_threads()
+    );
+
+    printf("%-10s %8.2f ms/slot\n", "waterfall", wf_ns / 1e6 / total_slots);
+
+    for (int i = 0; i < FT8_SLOT_STAGE_LAST; i++) {
+        printf("%-10s %8.2f ms/slot\n", ft8_slot_stage_name(i), slot_ns[i] / 1e6 / total_slots);
+    }
+
+    if (check) {
+        printf("\nquantizer check: %llu waterfall cells differ\n", (unsigned long long) total_mismatch);
+    }
+
+    return total_mismatch ? 1 : 0;
+}
@@ -0,0 +1,155 @@
+/*
+ *  SPDX-License-Identifier: LGPL-2.1-or-later
+ *
+ *  Xiegu X6100 LVGL GUI
+ *
+ *  Copyright (c) 2022-2023 Belousov Oleg aka R1CBU
+ */
+
+/*
+ * Benchmark of the block Hilbert converter against liquid firhilbf_r2c_execute()
+ * per sample, as dsp_put_audio_samples() did it. Exits with error if the results
+ * differ more than float rounding.
+ *
+ * hilbert_bench [-n periods]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <math.h>
+#include <liquid/liquid.h>
+
+#include "../hilbert.h"
+#include "../audio.h"
+
+#define PERIOD      (AUDIO_CAPTURE_RATE / 10)   /* Capture fragment, 100 ms */
+#define MAX_ERROR   1e-5f
+
+static float            x[PERIOD];
+static float complex    y_ref[PERIOD];
+static float complex    y[PERIOD];
+
+static uint64_t now_ns() {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint64_t) now.tv_sec * 1000000000L + now.tv_nsec;
+}
+
+static void fill(uint32_t *seed) {
+    for (uint32_t i = 0; i < PERIOD; i++) {
+        *seed = *seed * 1664525u + 1013904223u;
+        x[i] = (int16_t) (*seed >> 16) / 32768.0f;
+    }
+}
+
+/* Many periods with odd split sizes, to check the state between calls */
+
+static int self_check() {
+    static const size_t splits[] = { 1, 7, 512, 513, 1000, PERIOD };
+    firhilbf            ref = firhilbf_create(7, 60.0f);
+    hilbert_t           h = hilbert_create(7, 60.0f);
+    uint32_t            seed = 1;
+    float               max_err = 0.0f;
+    bool                re_exact = true;
+
+    for (uint32_t period = 0; period < 20; period++) {
+        fill(&seed);
+
+        for (uint32_t i = 0; i < PERIOD; i++) {
+            firhilbf_r2c_execute(ref, x[i], &y_ref[i]);
+        }
+
+        size_t split = splits[period % (sizeof(splits) / sizeof(splits[0]))];
+
+        for (size_t pos = 0; pos < PERIOD; pos += split) {
+            hilbert_execute(h, x + pos, pos + split > PERIOD ? PERIOD - pos : split, y + pos);
+        }
+
+        for (uint32_t i = 0; i < PERIOD; i++) {
+            float err = cabsf(y[i] - y_ref[i]);
+
+            if (err > max_err) {
+                max_err = err;
+            }
+
+            if (crealf(y[i]) != crealf(y_ref[i])) {
+                re_exact = false;
+            }
+        }
+    }
+
+    firhilbf_destroy(ref);
+    hilbert_destroy(h);
+
+    printf("max error:        %g, real part %s\n", max_err, re_exact ? "exact" : "differs");
+
+    if (max_err > MAX_ERROR) {
+        fprintf(stderr, "Error %g is more than %g\n", max_err, MAX_ERROR);
+        return 1;
+    }
+
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    uint32_t    periods = 1000;
+    int         opt;
+
+    while ((opt = getopt(argc, argv, "n:")) != -1) {
+        switch (opt) {
+            case 'n':
+                periods = atoi(optarg);
+                break;
+
+            default:
+                fprintf(stderr, "Usage: %s [-n periods]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    if (self_check()) {
+        return 1;
+    }
+
+    /* Timing */
+
+    firhilbf    ref = firhilbf_create(7, 60.0f);
+    hilbert_t   h = hilbert_create(7, 60.0f);
+    uint32_t    seed = 2;
+
+    fill(&seed);
+
+    uint64_t start = now_ns();
+
+    for (uint32_t n = 0; n < periods; n++) {
+        for (uint32_t i = 0; i < PERIOD; i++) {
+            firhilbf_r2c_execute(ref, x[i], &y_ref[i]);
+        }
+    }
+
+    uint64_t ref_ns = now_ns() - start;
+
+    start = now_ns();
+
+    for (uint32_t n = 0; n < periods; n++) {
+        hilbert_execute(h, x, PERIOD, y);
+    }
+
+    uint64_t block_ns = now_ns() - start;
+    double   samples = (double) periods * PERIOD;
+
+    printf("periods:          %u x %u samples\n", periods, PERIOD);
+    printf("firhilbf:         %8.2f ns/sample\n", ref_ns / samples);
+    printf("block:            %8.2f ns/sample (%.1fx)\n", block_ns / samples, (double) ref_ns / block_ns);
+
+    firhilbf_destroy(ref);
+    hilbert_destroy(h);
+
+    return 0;
+}
@@ -0,0 +1,360 @@
+/*
+ *  SPDX-License-Identifier: LGPL-2.1-or-later
+ *
+ *  Xiegu X6100 LVGL GUI
+ *
+ *  Copyright (c) 2022-2023 Belousov Oleg aka R1CBU
+ */
+
+/*
+ * Benchmark of FT8 LDPC decoders: dense ldpc_decode(), bp_decode() and
+ * sparse ldpc_minsum_decode(), the latter also with OSD-1/OSD-2 fallback
+ * accepted by discrepancy and CRC like in ft8_decode_osd(). Random FT8
+ * messages are encoded, passed through AWGN and normalized like ft8_decode()
+ * does.
+ *
+ * "wrong" counts codewords accepted by the decoder but differing from the
+ * transmitted one, i.e. false decodes. The last rows decode pure noise, where
+ * every accepted codeword is a false decode, with and without the OSD
+ * discrepancy limit.
+ *
+ * ldpc_bench [-n codewords] [-i iterations] [-s from:to:step Eb/N0 dB] [-f noise vectors]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <math.h>
+
+#include "../ft8/constants.h"
+#include "../ft8/encode.h"
+#include "../ft8/ldpc.h"
+#include "../ft8/crc.h"
+
+typedef struct {
+    const char  *name;
+    uint32_t    ok;
+    uint32_t    wrong;
+    uint64_t    ns;
+} result_t;
+
+enum {
+    DEC_DENSE = 0,
+    DEC_BP,
+    DEC_MINSUM,
+    DEC_OSD1,
+    DEC_OSD2,
+
+    DEC_LAST
+};
+
+static uint32_t         seed = 1;
+static ldpc_workspace_t ws;
+static ldpc_osd_workspace_t osd_ws;
+
+static uint32_t rnd() {
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+
+    return seed;
+}
+
+static float gauss() {
+    float u1 = (rnd() + 1.0f) / 4294967296.0f;
+    float u2 = rnd() / 4294967296.0f;
+
+    return sqrtf(-2.0f * logf(u1)) * cosf(2.0f * M_PI * u2);
+}
+
+static uint64_t now_ns() {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint64_t) now.tv_sec * 1000000000L + now.tv_nsec;
+}
+
+/**
+ * Random 77 bit payload to 174 codeword bits, through the real FT8 encoder
+ */
+static void make_codeword(uint8_t bits[]) {
+    uint8_t payload[10];
+    uint8_t tones[FT8_NN];
+
+    for (int i = 0; i < 10; i++) {
+        payload[i] = rnd();
+    }
+    payload[9] &= 0xF8;
+
+    ft8_encode(payload, tones);
+
+    int k = 0;
+
+    for (int i = 0; i < FT8_NN; i++) {
+        if (i < 7 || (i >= 36 && i < 43) || i >= 72) {
+            continue;
+        }
+
+        uint8_t bits3 = 0;
+
+        while (kFT8_Gray_map[bits3] != tones[i]) {
+            bits3++;
+        }
+
+        bits[k++] = (bits3 >> 2) & 1;
+        bits[k++] = (bits3 >> 1) & 1;
+        bits[k++] = bits3 & 1;
+    }
+}
+
+static bool parity_ok(const uint8_t bits[]) {
+    for (int m = 0; m < FTX_LDPC_M; m++) {
+        uint8_t x = 0;
+
+        for (int i = 0; i < kFTX_LDPC_Num_rows[m]; i++) {
+            x ^= bits[kFTX_LDPC_Nm[m][i] - 1];
+        }
+
+        if (x) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/* Same CRC check as ft8_decode() */
+
+static bool crc_ok(const uint8_t bits[]) {
+    uint8_t a91[FTX_LDPC_K_BYTES] = { 0 };
+
+    for (int i = 0; i < FTX_LDPC_K; i++) {
+        if (bits[i]) {
+            a91[i / 8] |= 0x80 >> (i % 8);
+        }
+    }
+
+    uint16_t crc = ftx_extract_crc(a91);
+
+    a91[9] &= 0xF8;
+    a91[10] = 0;
+
+    return crc == ftx_compute_crc(a91, 96 - 14);
+}
+
+/* Same as ftx_normalize_logl() in decode.c */
+
+static void normalize(float *log174) {
+    float sum = 0;
+    float sum2 = 0;
+
+    for (int i = 0; i < FTX_LDPC_N; i++) {
+        sum += log174[i];
+        sum2 += log174[i] * log174[i];
+    }
+
+    float inv_n = 1.0f / FTX_LDPC_N;
+    float variance = (sum2 - (sum * sum * inv_n)) * inv_n;
+    float norm_factor = sqrtf(24.0f / variance);
+
+    for (int i = 0; i < FTX_LDPC_N; i++) {
+        log174[i] *= norm_factor;
+    }
+}
+
+static void run(int dec, float *llr, int iters, const uint8_t *bits, result_t *res) {
+    float       copy[FTX_LDPC_N];
+    uint8_t     plain[FTX_LDPC_N];
+    int         errors;
+
+    memcpy(copy, llr, sizeof(copy));
+
+    uint64_t start = now_ns();
+
+    switch (dec) {
+        case DEC_DENSE:
+            ldpc_decode(copy, iters, plain, &errors);
+            break;
+
+        case DEC_BP:
+            bp_decode(copy, iters, plain, &errors);
+            break;
+
+        case DEC_MINSUM:
+            ldpc_minsum_decode(&ws, copy, iters, plain, &errors);
+            break;
+
+        case DEC_OSD1:
+        case DEC_OSD2:
+            ldpc_minsum_decode(&ws, copy, iters, plain, &errors);
+
+            if (errors > 0) {
+                float discrepancy = ldpc_osd_decode(&osd_ws, copy, dec == DEC_OSD1 ? 1 : 2, plain);
+
+                errors = ldpc_osd_reliable(copy, discrepancy) && crc_ok(plain) ? 0 : 1;
+            }
+            break;
+    }
+
+    res->ns += now_ns() - start;
+
+    if (errors == 0) {
+        if (memcmp(plain, bits, FTX_LDPC_N) == 0) {
+            res->ok++;
+        } else {
+            res->wrong++;
+        }
+    }
+}
+
+int main(int argc, char *argv[]) {
+    uint32_t    count = 2000;
+    uint32_t    noise = 100000;
+    int         iters = 20;
+    float       snr_from = 1.0f, snr_to = 4.0f, snr_step = 0.5f;
+    int         opt;
+
+    while ((opt = getopt(argc, argv, "n:i:s:f:")) != -1) {
+        switch (opt) {
+            case 'n':
+                count = atoi(optarg);
+                break;
+
+            case 'i':
+                iters = atoi(optarg);
+                break;
+
+            case 's':
+                if (sscanf(optarg, "%f:%f:%f", &snr_from, &snr_to, &snr_step) != 3 || snr_step <= 0) {
+                    fprintf(stderr, "Wrong SNR range %s\n", optarg);
+                    return 1;
+                }
+                break;
+
+            case 'f':
+                noise = atoi(optarg);
+                break;
+
+            default:
+                fprintf(stderr, "Usage: %s [-n codewords] [-i iterations] [-s from:to:step] [-f noise vectors]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    uint8_t bits[FTX_LDPC_N];
+
+    make_codeword(bits);
+
+    if (!parity_ok(bits) || !crc_ok(bits)) {
+        fprintf(stderr, "Encoder check failed\n");
+        return 1;
+    }
+
+    /* OSD of noiseless LLR must return the codeword itself */
+
+    float   clean[FTX_LDPC_N];
+    uint8_t plain[FTX_LDPC_N];
+
+    for (int i = 0; i < FTX_LDPC_N; i++) {
+        clean[i] = bits[i] ? 1.0f + i * 0.01f : -1.0f - i * 0.01f;
+    }
+
+    if (ldpc_osd_decode(&osd_ws, clean, 2, plain) != 0.0f || memcmp(plain, bits, FTX_LDPC_N) != 0) {
+        fprintf(stderr, "OSD check failed\n");
+        return 1;
+    }
+
+    printf("%u codewords per point, %d iterations\n\n", count, iters);
+    printf("%8s  %-8s %8s %8s %10s\n", "Eb/N0", "decoder", "ok %", "wrong", "us/call");
+
+    for (float snr = snr_from; snr <= snr_to + 1e-3f; snr += snr_step) {
+        result_t    res[DEC_LAST] = {
+            [DEC_DENSE] = { .name = "dense" },
+            [DEC_BP] = { .name = "bp" },
+            [DEC_MINSUM] = { .name = "minsum" },
+            [DEC_OSD1] = { .name = "osd1" },
+            [DEC_OSD2] = { .name = "osd2" },
+        };
+
+        /* Rate 91/174 BPSK */
+
+        float sigma = sqrtf(1.0f / (2.0f * FTX_LDPC_K / FTX_LDPC_N * powf(10.0f, snr / 10.0f)));
+
+        for (uint32_t n = 0; n < count; n++) {
+            float llr[FTX_LDPC_N];
+
+            make_codeword(bits);
+
+            for (int i = 0; i < FTX_LDPC_N; i++) {
+                float y = (bits[i] ? 1.0f : -1.0f) + sigma * gauss();
+
+                llr[i] = 2.0f * y / (sigma * sigma);
+            }
+
+            normalize(llr);
+
+            for (int dec = 0; dec < DEC_LAST; dec++) {
+                run(dec, llr, iters, bits, &res[dec]);
+            }
+        }
+
+        for (int dec = 0; dec < DEC_LAST; dec++) {
+            printf("%8.1f  %-8s %8.1f %8u %10.1f\n",
+                snr, res[dec].name, res[dec].ok * 100.0 / count, res[dec].wrong, res[dec].ns / 1000.0 / count
+            );
+        }
+    }
+
+    /* Pure noise, as most OSD candidates of a slot are */
+
+    printf("\n%u noise vectors\n\n", noise);
+    printf("%-8s %10s %10s\n", "decoder", "crc only", "accepted");
+
+    uint32_t    crc_only[2] = { 0 };
+    uint32_t    accepted[2] = { 0 };
+
+    for (uint32_t n = 0; n < noise; n++) {
+        float   llr[FTX_LDPC_N];
+        int     errors;
+
+        for (int i = 0; i < FTX_LDPC_N; i++) {
+            llr[i] = gauss();
+        }
+
+        normalize(llr);
+        ldpc_minsum_decode(&ws, llr, iters, plain, &errors);
+
+        if (errors == 0) {
+            if (crc_ok(plain)) {
+                crc_only[0]++;
+                crc_only[1]++;
+                accepted[0]++;
+                accepted[1]++;
+            }
+            continue;
+        }
+
+        for (int depth = 1; depth <= 2; depth++) {
+            float discrepancy = ldpc_osd_decode(&osd_ws, llr, depth, plain);
+
+            if (crc_ok(plain)) {
+                crc_only[depth - 1]++;
+
+                if (ldpc_osd_reliable(llr, discrepancy)) {
+                    accepted[depth - 1]++;
+                }
+            }
+        }
+    }
+
+    for (int depth = 1; depth <= 2; depth++) {
+        printf("osd%-5d %10u %10u\n", depth, crc_only[depth - 1], accepted[depth - 1]);
+    }
+
+    return 0;
+}
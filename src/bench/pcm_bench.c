@@ -0,0 +1,257 @@
+/*
+ *  SPDX-License-Identifier: LGPL-2.1-or-later
+ *
+ *  Xiegu X6100 LVGL GUI
+ *
+ *  Copyright (c) 2022-2023 Belousov Oleg aka R1CBU
+ */
+
+/*
+ * Benchmark of the 16 bit audio kernels against the scalar reference.
+ * Exits with error if the results differ.
+ *
+ * pcm_bench [-n blocks]
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <math.h>
+
+#include "../pcm.h"
+
+#define BLOCK       2048
+#define GAIN_DB     3.0f
+
+static int16_t      src[BLOCK];
+static int16_t      dst[BLOCK];
+static int16_t      ref[BLOCK];
+static float        fbuf[BLOCK];
+static float        fref[BLOCK];
+
+static volatile uint16_t    peak;
+
+static uint64_t now_ns() {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint64_t) now.tv_sec * 1000000000L + now.tv_nsec;
+}
+
+/* Old audio_gain_db(), as baseline */
+
+static void gain_baseline(int16_t *buf, size_t samples, float gain, int16_t *out) {
+    float scale = exp10f(gain / 10.0f);
+
+    for (uint16_t i = 0; i < samples; i++) {
+        int32_t x = buf[i] * scale;
+
+        if (x > 32767) {
+            x = 32767;
+        }
+
+        if (x < -32767) {
+            x = -32767;
+        }
+
+        out[i] = x;
+    }
+}
+
+static int check_s16(const char *name, const int16_t *a, const int16_t *b, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        if (a[i] != b[i]) {
+            fprintf(stderr, "%s mismatch at %zu: %i != %i\n", name, i, a[i], b[i]);
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+static int check_float(const char *name, const float *a, const float *b, size_t n) {
+    if (memcmp(a, b, n * sizeof(float)) != 0) {
+        fprintf(stderr, "%s mismatch\n", name);
+        return 1;
+    }
+
+    return 0;
+}
+
+/* Lengths not multiple of the vector width check the scalar tails too */
+
+static int self_check() {
+    static const size_t lengths[] = { 0, 1, 7, 8, 9, 31, BLOCK };
+    int                 err = 0;
+
+    gain_baseline(src, BLOCK, GAIN_DB, ref);
+    pcm_gain(dst, src, BLOCK, pcm_db_scale(GAIN_DB));
+    err |= check_s16("gain vs audio_gain_db", dst, ref, BLOCK);
+
+    for (size_t l = 0; l < sizeof(lengths) / sizeof(lengths[0]); l++) {
+        size_t n = lengths[l];
+
+        pcm_gain_scalar(ref, src, n, 2.5f);
+        pcm_gain(dst, src, n, 2.5f);
+        err |= check_s16("gain", dst, ref, n);
+
+        pcm_to_float_scalar(fref, src, n);
+        pcm_to_float(fbuf, src, n);
+        err |= check_float("to_float", fbuf, fref, n);
+
+        for (size_t i = 0; i < n; i++) {
+            fbuf[i] *= 1.7f;
+        }
+
+        pcm_from_float_scalar(ref, fbuf, n);
+        pcm_from_float(dst, fbuf, n);
+        err |= check_s16("from_float", dst, ref, n);
+
+        memcpy(ref, src, sizeof(src));
+        memcpy(dst, src, sizeof(src));
+        pcm_mix_scalar(ref, src + 3, n, 0.7f);
+        pcm_mix(dst, src + 3, n, 0.7f);
+        err |= check_s16("mix", dst, ref, n);
+
+        size_t m = n < BLOCK ? n : BLOCK - 1;
+
+        if (pcm_peak(src + 1, m) != pcm_peak_scalar(src + 1, m)) {
+            fprintf(stderr, "peak mismatch at length %zu\n", m);
+            err = 1;
+        }
+    }
+
+    if (pcm_peak(src, BLOCK) != 32768) {
+        fprintf(stderr, "peak of -32768 is not 32768\n");
+        err = 1;
+    }
+
+    /* DC blocker removes offset */
+
+    pcm_dc_t dc = { 0 };
+
+    for (size_t i = 0; i < BLOCK; i++) {
+        ref[i] = 1000;
+    }
+
+    for (int i = 0; i < 50; i++) {
+        pcm_dc_block(&dc, dst, ref, BLOCK);
+    }
+
+    if (abs(dst[BLOCK - 1]) > 1) {
+        fprintf(stderr, "DC blocker left %i\n", dst[BLOCK - 1]);
+        err = 1;
+    }
+
+    return err;
+}
+
+int main(int argc, char *argv[]) {
+    uint32_t    blocks = 100000;
+    int         opt;
+
+    while ((opt = getopt(argc, argv, "n:")) != -1) {
+        switch (opt) {
+            case 'n':
+                blocks = atoi(optarg);
+                break;
+
+            default:
+                fprintf(stderr, "Usage: %s [-n blocks]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    uint32_t seed = 1;
+
+    for (uint16_t i = 0; i < BLOCK; i++) {
+        seed = seed * 1664525u + 1013904223u;
+        src[i] = seed >> 16;
+    }
+
+    src[0] = -32768;
+    src[1] = 32767;
+
+    if (self_check()) {
+        return 1;
+    }
+
+    /* Timing */
+
+    float       scale = pcm_db_scale(GAIN_DB);
+    uint64_t    start = now_ns();
+
+    for (uint32_t n = 0; n < blocks; n++) {
+        gain_baseline(src, BLOCK, GAIN_DB, dst);
+    }
+
+    uint64_t baseline_ns = now_ns() - start;
+
+    start = now_ns();
+
+    for (uint32_t n = 0; n < blocks; n++) {
+        pcm_gain(dst, src, BLOCK, scale);
+    }
+
+    uint64_t gain_ns = now_ns() - start;
+
+    start = now_ns();
+
+    for (uint32_t n = 0; n < blocks; n++) {
+        pcm_to_float(fbuf, src, BLOCK);
+    }
+
+    uint64_t to_float_ns = now_ns() - start;
+
+    start = now_ns();
+
+    for (uint32_t n = 0; n < blocks; n++) {
+        pcm_from_float(dst, fbuf, BLOCK);
+    }
+
+    uint64_t from_float_ns = now_ns() - start;
+
+    start = now_ns();
+
+    for (uint32_t n = 0; n < blocks; n++) {
+        pcm_mix(dst, src, BLOCK, 0.5f);
+    }
+
+    uint64_t mix_ns = now_ns() - start;
+
+    start = now_ns();
+
+    for (uint32_t n = 0; n < blocks; n++) {
+        peak = pcm_peak(src, BLOCK);
+    }
+
+    uint64_t peak_ns = now_ns() - start;
+
+    pcm_dc_t dc = { 0 };
+
+    start = now_ns();
+
+    for (uint32_t n = 0; n < blocks; n++) {
+        pcm_dc_block(&dc, dst, src, BLOCK);
+    }
+
+    uint64_t dc_ns = now_ns() - start;
+    double   samples = (double) blocks * BLOCK;
+
+    printf("blocks:           %u x %u samples\n", blocks, BLOCK);
+    printf("audio_gain_db:    %8.1f Msamples/s\n", samples / baseline_ns * 1e3);
+    printf("gain:             %8.1f Msamples/s (%.1fx)\n", samples / gain_ns * 1e3, (double) baseline_ns / gain_ns);
+    printf("to float:         %8.1f Msamples/s\n", samples / to_float_ns * 1e3);
+    printf("from float:       %8.1f Msamples/s\n", samples / from_float_ns * 1e3);
+    printf("mix:              %8.1f Msamples/s\n", samples / mix_ns * 1e3);
+    printf("peak:             %8.1f Msamples/s\n", samples / peak_ns * 1e3);
+    printf("dc block:         %8.1f Msamples/s\n", samples / dc_ns * 1e3);
+
+    return 0;
+}
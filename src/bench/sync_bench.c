@@ -0,0 +1,393 @@
+/*
+ *  SPDX-License-Identifier: LGPL-2.1-or-later
+ *
+ *  Xiegu X6100 LVGL GUI
+ *
+ *  Copyright (c) 2022-2023 Belousov Oleg aka R1CBU
+ */
+
+/*
+ * Benchmark of FT8 sync search: ft8_find_sync() against the brute force
+ * per candidate scoring it replaced. The waterfall has the geometry of
+ * dialog_ft8 (4x time, 2x frequency oversampling) and is filled with noise
+ * and random FT8 signals placed directly as tone magnitudes.
+ *
+ * Every candidate returned by ft8_find_sync() must have the reference score.
+ * "recall" is the share of reference candidates strictly above the last
+ * reference score that are found too, "signals" counts injected signals
+ * with a candidate at their position. ft8_snr() of the returned candidates
+ * must match the sort based estimate it replaced.
+ *
+ * sync_bench [-n waterfalls] [-s signals] [-c candidates]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <math.h>
+
+#include "../ft8/constants.h"
+#include "../ft8/decode.h"
+#include "../ft8/encode.h"
+
+#define TIME_OSR    4
+#define FREQ_OSR    2
+#define NUM_BINS    882
+#define NUM_BLOCKS  93
+#define MIN_SCORE   10
+
+typedef struct {
+    int         block;
+    int         time_sub;
+    int         freq_sub;
+    int         bin;
+} signal_t;
+
+static uint32_t seed = 1;
+
+static uint32_t rnd() {
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+
+    return seed;
+}
+
+static float gauss() {
+    float u1 = (rnd() + 1.0f) / 4294967296.0f;
+    float u2 = rnd() / 4294967296.0f;
+
+    return sqrtf(-2.0f * logf(u1)) * cosf(2.0f * M_PI * u2);
+}
+
+static uint64_t now_ns() {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint64_t) now.tv_sec * 1000000000L + now.tv_nsec;
+}
+
+static uint8_t *cell(waterfall_t *wf, int block, int time_sub, int freq_sub, int bin) {
+    return wf->mag + ((block * wf->time_osr + time_sub) * wf->freq_osr + freq_sub) * wf->num_bins + bin;
+}
+
+static void put(waterfall_t *wf, int block, int time_sub, int freq_sub, int bin, int level) {
+    if (block < 0 || block >= wf->num_blocks || bin < 0 || bin >= wf->num_bins) {
+        return;
+    }
+
+    uint8_t *p = cell(wf, block, time_sub, freq_sub, bin);
+
+    if (level > *p) {
+        *p = level > 255 ? 255 : level;
+    }
+}
+
+/**
+ * Noise around -190 dB and FT8 signals 3..30 dB above it. The FFT window is
+ * two blocks long, so the tone leaks 2 dB less per time subdivision away
+ * from it, sub-bin neighbours get it 6 dB lower
+ */
+static void make_waterfall(waterfall_t *wf, signal_t *signals, int num_signals) {
+    for (int i = 0; i < wf->num_blocks * wf->block_stride; i++) {
+        int x = 100 + gauss() * 6.0f;
+
+        wf->mag[i] = x < 0 ? 0 : (x > 255 ? 255 : x);
+    }
+
+    for (int n = 0; n < num_signals; n++) {
+        signal_t    *s = &signals[n];
+        uint8_t     payload[10];
+        uint8_t     tones[FT8_NN];
+
+        for (int i = 0; i < 10; i++) {
+            payload[i] = rnd();
+        }
+        payload[9] &= 0xF8;
+
+        ft8_encode(payload, tones);
+
+        s->block = (int) (rnd() % 16) - 6;
+        s->time_sub = rnd() % TIME_OSR;
+        s->freq_sub = rnd() % FREQ_OSR;
+        s->bin = rnd() % (NUM_BINS - 8);
+
+        int level = 100 + 6 + rnd() % 54;
+
+        for (int i = 0; i < FT8_NN; i++) {
+            int block = s->block + i;
+            int bin = s->bin + tones[i];
+
+            for (int dt = -TIME_OSR + 1; dt < TIME_OSR; dt++) {
+                for (int df = -1; df <= 1; df++) {
+                    int t = s->time_sub + dt;
+                    int f = s->freq_sub + df;
+                    int b = block + (t < 0 ? -1 : (t >= TIME_OSR ? 1 : 0));
+                    int k = bin + (f < 0 ? -1 : (f >= FREQ_OSR ? 1 : 0));
+
+                    put(wf, b, (t + TIME_OSR) % TIME_OSR, (f + FREQ_OSR) % FREQ_OSR, k, level - abs(dt) * 4 - (df ? 12 : 0));
+                }
+            }
+        }
+    }
+}
+
+/* Same as ft8_sync_score() replaced by the sync search in decode.c */
+
+static int ref_score(const waterfall_t *wf, const candidate_t *candidate) {
+    int score = 0;
+    int num_average = 0;
+
+    const uint8_t *mag_cand = cell((waterfall_t *) wf, candidate->time_offset, candidate->time_sub, candidate->freq_sub, candidate->freq_offset);
+
+    for (int m = 0; m < FT8_NUM_SYNC; ++m) {
+        for (int k = 0; k < FT8_LENGTH_SYNC; ++k) {
+            int block = (FT8_SYNC_OFFSET * m) + k;
+            int block_abs = candidate->time_offset + block;
+
+            if (block_abs < 0)
+                continue;
+            if (block_abs >= wf->num_blocks)
+                break;
+
+            const uint8_t *p8 = mag_cand + (block * wf->block_stride);
+            int sm = kFT8_Costas_pattern[k];
+
+            if (sm > 0) {
+                score += p8[sm] - p8[sm - 1];
+                ++num_average;
+            }
+            if (sm < 7) {
+                score += p8[sm] - p8[sm + 1];
+                ++num_average;
+            }
+            if ((k > 0) && (block_abs > 0)) {
+                score += p8[sm] - p8[sm - wf->block_stride];
+                ++num_average;
+            }
+            if (((k + 1) < FT8_LENGTH_SYNC) && ((block_abs + 1) < wf->num_blocks)) {
+                score += p8[sm] - p8[sm + wf->block_stride];
+                ++num_average;
+            }
+        }
+    }
+
+    if (num_average > 0)
+        score /= num_average;
+
+    return score;
+}
+
+static int cmp_score(const void *a, const void *b) {
+    return ((const candidate_t *) b)->score - ((const candidate_t *) a)->score;
+}
+
+/**
+ * Brute force search, all candidates above min_score sorted by score
+ */
+static int ref_find_sync(const waterfall_t *wf, candidate_t *list) {
+    int         count = 0;
+    candidate_t c = { 0 };
+
+    for (c.time_sub = 0; c.time_sub < wf->time_osr; c.time_sub++) {
+        for (c.freq_sub = 0; c.freq_sub < wf->freq_osr; c.freq_sub++) {
+            for (c.time_offset = -12; c.time_offset < 24; c.time_offset++) {
+                for (c.freq_offset = 0; c.freq_offset + 7 < wf->num_bins; c.freq_offset++) {
+                    c.score = ref_score(wf, &c);
+
+                    if (c.score >= MIN_SCORE) {
+                        list[count++] = c;
+                    }
+                }
+            }
+        }
+    }
+
+    qsort(list, count, sizeof(candidate_t), cmp_score);
+
+    return count;
+}
+
+static int cmp_mag(const void *a, const void *b) {
+    return *(const uint8_t *) a - *(const uint8_t *) b;
+}
+
+/* Same as get_snr() replaced by ft8_snr(), with the zoom sorted completely */
+
+static int ref_snr(const waterfall_t *wf, const candidate_t *candidate) {
+    int     m = wf->freq_osr * wf->time_osr;
+    int     l = 8 * m;
+    int     n = 2 * m;
+    float   minC = 0, maxC = 0;
+    uint8_t zoom[l];
+
+    for (int i = 0; i < wf->num_blocks; i++) {
+        memcpy(zoom, wf->mag + i * wf->block_stride + candidate->freq_offset + candidate->freq_sub, l);
+        qsort(zoom, l, 1, cmp_mag);
+
+        for (int j = 0; j < n; j++) {
+            minC += zoom[j + n];
+        }
+
+        for (int j = 1; j <= m; j++) {
+            maxC += zoom[l - j];
+        }
+    }
+
+    minC = minC / (wf->num_blocks * wf->freq_osr * wf->time_osr * 2);
+    maxC = maxC / (wf->num_blocks * wf->freq_osr * wf->time_osr);
+
+    int min = (int) (minC / 2 - 240);
+    int max = (int) (maxC / 2 - 240);
+
+    return max - min - 26;
+}
+
+static bool same(const candidate_t *a, const candidate_t *b) {
+    return a->time_offset == b->time_offset && a->freq_offset == b->freq_offset &&
+           a->time_sub == b->time_sub && a->freq_sub == b->freq_sub;
+}
+
+static bool found(const candidate_t *list, int count, const signal_t *s) {
+    for (int i = 0; i < count; i++) {
+        const candidate_t *c = &list[i];
+
+        if (abs(c->time_offset - s->block) <= 1 && abs(c->freq_offset - s->bin) <= 1) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+int main(int argc, char *argv[]) {
+    int         count = 20;
+    int         num_signals = 30;
+    int         num_candidates = 120;
+    int         opt;
+
+    while ((opt = getopt(argc, argv, "n:s:c:")) != -1) {
+        switch (opt) {
+            case 'n':
+                count = atoi(optarg);
+                break;
+
+            case 's':
+                num_signals = atoi(optarg);
+                break;
+
+            case 'c':
+                num_candidates = atoi(optarg);
+                break;
+
+            default:
+                fprintf(stderr, "Usage: %s [-n waterfalls] [-s signals] [-c candidates]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    waterfall_t wf = {
+        .max_blocks = NUM_BLOCKS,
+        .num_blocks = NUM_BLOCKS,
+        .num_bins = NUM_BINS,
+        .time_osr = TIME_OSR,
+        .freq_osr = FREQ_OSR,
+        .block_stride = TIME_OSR * FREQ_OSR * NUM_BINS,
+        .protocol = PROTO_FT8
+    };
+
+    wf.mag = malloc(NUM_BLOCKS * wf.block_stride);
+
+    sync_workspace_t sync_ws;
+
+    if (!ft8_sync_workspace_init(&sync_ws, &wf)) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+
+    candidate_t *ref = malloc(sizeof(candidate_t) * TIME_OSR * FREQ_OSR * 36 * NUM_BINS);
+    candidate_t *heap = malloc(sizeof(candidate_t) * num_candidates);
+    signal_t    *signals = malloc(sizeof(signal_t) * num_signals);
+
+    uint64_t    ref_ns = 0, new_ns = 0;
+    uint64_t    ref_snr_ns = 0, new_snr_ns = 0;
+    uint32_t    snr_count = 0;
+    uint32_t    above = 0, recalled = 0;
+    uint32_t    ref_signals = 0, new_signals = 0;
+
+    for (int n = 0; n < count; n++) {
+        make_waterfall(&wf, signals, num_signals);
+
+        uint64_t start = now_ns();
+        int ref_count = ref_find_sync(&wf, ref);
+
+        ref_ns += now_ns() - start;
+
+        start = now_ns();
+        int heap_size = ft8_find_sync(&wf, &sync_ws, num_candidates, heap, MIN_SCORE);
+
+        new_ns += now_ns() - start;
+
+        for (int i = 0; i < heap_size; i++) {
+            if (heap[i].score != ref_score(&wf, &heap[i])) {
+                fprintf(stderr, "Score mismatch: %d ref %d\n", heap[i].score, ref_score(&wf, &heap[i]));
+                return 1;
+            }
+
+            start = now_ns();
+            int snr = ref_snr(&wf, &heap[i]);
+
+            ref_snr_ns += now_ns() - start;
+
+            start = now_ns();
+            heap[i].snr = ft8_snr(&wf, &heap[i]);
+
+            new_snr_ns += now_ns() - start;
+            snr_count++;
+
+            if (heap[i].snr != snr) {
+                fprintf(stderr, "SNR mismatch: %d ref %d\n", heap[i].snr, snr);
+                return 1;
+            }
+        }
+
+        int ref_top = ref_count < num_candidates ? ref_count : num_candidates;
+        int last = ref_top > 0 ? ref[ref_top - 1].score : 0;
+
+        for (int i = 0; i < ref_top && ref[i].score > last; i++) {
+            above++;
+
+            for (int k = 0; k < heap_size; k++) {
+                if (same(&ref[i], &heap[k])) {
+                    recalled++;
+                    break;
+                }
+            }
+        }
+
+        for (int i = 0; i < num_signals; i++) {
+            ref_signals += found(ref, ref_top, &signals[i]);
+            new_signals += found(heap, heap_size, &signals[i]);
+        }
+    }
+
+    printf("%d waterfalls %dx%d, %d signals, %d candidates\n\n", count, NUM_BLOCKS, NUM_BINS, num_signals, num_candidates);
+    printf("%-12s %10s %10s\n", "", "ms/call", "signals %");
+    printf("%-12s %10.2f %10.1f\n", "brute force", ref_ns / 1e6 / count, ref_signals * 100.0 / (count * num_signals));
+    printf("%-12s %10.2f %10.1f\n", "find_sync", new_ns / 1e6 / count, new_signals * 100.0 / (count * num_signals));
+    printf("\nrecall %.1f%% of %u\n", above ? recalled * 100.0 / above : 100.0, above);
+    printf("snr us/call: sort %.1f, ft8_snr %.1f\n", ref_snr_ns / 1e3 / snr_count, new_snr_ns / 1e3 / snr_count);
+
+    free(wf.mag);
+    ft8_sync_workspace_free(&sync_ws);
+    free(ref);
+    free(heap);
+    free(signals);
+
+    return 0;
+}
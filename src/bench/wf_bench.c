@@ -0,0 +1,238 @@
+/*
+ *  SPDX-License-Identifier: LGPL-2.1-or-later
+ *
+ *  Xiegu X6100 LVGL GUI
+ *
+ *  Copyright (c) 2022-2023 Belousov Oleg aka R1CBU
+ */
+
+/*
+ * Benchmark of the waterfall row kernel against the old per-bin palette mapping.
+ * Exits with error if the kernel differs from the old mapping (by one index right
+ * at a step boundary is rounding and allowed) or from the scalar reference,
+ * over random rows and edge values of several dB ranges.
+ *
+ * wf_bench [-n rows]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <math.h>
+
+#include "../wf_palette.h"
+#include "../dsp.h"
+
+#define MIN_DB  -121.0f
+#define MAX_DB  -73.0f
+
+static float        psd[WATERFALL_NFFT];
+static uint8_t      ids[WATERFALL_NFFT];
+static uint8_t      ids_ref[WATERFALL_NFFT];
+static float        check_psd[WATERFALL_NFFT];
+static lv_color_t   row[WATERFALL_NFFT];
+static lv_color_t   palette[256];
+
+static uint64_t now_ns() {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint64_t) now.tv_sec * 1000000000L + now.tv_nsec;
+}
+
+/* Old per-bin loop of waterfall_data(), as baseline */
+
+static uint8_t id_baseline(float x, float min, float max) {
+    float v = (x - min) / (max - min);
+
+    if (v < 0.0f) {
+        v = 0.0f;
+    } else if (v > 1.0f) {
+        v = 1.0f;
+    }
+
+    return v * 254 + 1;
+}
+
+static void row_baseline(lv_color_t *dst, const float *src, uint16_t size, float min, float max) {
+    for (uint16_t x = 0; x < size; x++) {
+        uint8_t id = id_baseline(src[x], min, max);
+
+        memcpy(&dst[size - 1 - x], &palette[id], sizeof(lv_color_t));
+    }
+}
+
+static uint32_t rand_next(uint32_t *seed) {
+    *seed = *seed * 1664525u + 1013904223u;
+
+    return *seed >> 8;
+}
+
+/**
+ * Kernel against the old mapping, the scalar reference and palette lookup, n bins of check_psd.
+ * Returns bins off by one at a step boundary, or -1 on mismatch
+ */
+static int32_t check_row(uint16_t n, float min, float max) {
+    int32_t boundary = 0;
+
+    wf_quantize(ids, check_psd, n, min, max, 1, 255);
+    wf_quantize_scalar(ids_ref, check_psd, n, min, max, 1, 255);
+    wf_palette_row(row, check_psd, n, min, max, palette, 1, 255, true);
+
+    for (uint16_t i = 0; i < n; i++) {
+        float   x = check_psd[i];
+        uint8_t ref = id_baseline(x, min, max);
+
+        if (ids[i] != ids_ref[i]) {
+            fprintf(stderr, "Scalar mismatch at %u (%.9g dB): %u != %u\n", i, x, ids[i], ids_ref[i]);
+            return -1;
+        }
+
+        if (memcmp(&row[n - 1 - i], &palette[ids[i]], sizeof(lv_color_t)) != 0) {
+            fprintf(stderr, "Palette mismatch at %u (%.9g dB)\n", i, x);
+            return -1;
+        }
+
+        if (ids[i] != ref) {
+            float step = (x - min) / (max - min) * 254;
+
+            if (abs(ids[i] - ref) > 1 || fabsf(step - roundf(step)) > 1e-3f) {
+                fprintf(stderr, "Mismatch at %.9g dB of [%g, %g]: %u != %u\n", x, min, max, ids[i], ref);
+                return -1;
+            }
+            boundary++;
+        }
+    }
+
+    return boundary;
+}
+
+/**
+ * Random rows, then step boundaries and out of range values, in odd lengths for the kernel tail
+ */
+static int check_range(float min, float max, uint32_t *boundary) {
+    uint32_t    seed = 7;
+    int32_t     res;
+
+    for (uint16_t n = 0; n < 64; n++) {
+        uint16_t len = WATERFALL_NFFT - rand_next(&seed) % 32;
+
+        for (uint16_t i = 0; i < len; i++) {
+            check_psd[i] = min - 10.0f + (float) rand_next(&seed) / (1 << 24) * (max - min + 20.0f);
+        }
+
+        if ((res = check_row(len, min, max)) < 0) {
+            return 1;
+        }
+        *boundary += res;
+    }
+
+    uint16_t len = 0;
+
+    for (uint16_t id = 0; id <= 254; id++) {
+        float x = min + (max - min) * id / 254.0f;
+
+        check_psd[len++] = nextafterf(x, -INFINITY);
+        check_psd[len++] = x;
+        check_psd[len++] = nextafterf(x, INFINITY);
+    }
+
+    const float edges[] = { min, max, min - 1000.0f, max + 1000.0f, -1e30f, 1e30f, -INFINITY, INFINITY };
+
+    for (uint16_t i = 0; i < sizeof(edges) / sizeof(edges[0]); i++) {
+        check_psd[len++] = edges[i];
+    }
+
+    if ((res = check_row(len, min, max)) < 0) {
+        return 1;
+    }
+    *boundary += res;
+
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    uint32_t    rows = 100000;
+    int         opt;
+
+    while ((opt = getopt(argc, argv, "n:")) != -1) {
+        switch (opt) {
+            case 'n':
+                rows = atoi(optarg);
+                break;
+
+            default:
+                fprintf(stderr, "Usage: %s [-n rows]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    uint32_t seed = 1;
+
+    for (uint16_t i = 0; i < WATERFALL_NFFT; i++) {
+        seed = seed * 1664525u + 1013904223u;
+        psd[i] = MIN_DB - 10.0f + (float) (seed >> 8) / (1 << 24) * (MAX_DB - MIN_DB + 20.0f);
+    }
+
+    for (uint16_t i = 0; i < 256; i++) {
+        palette[i] = lv_color_make(i, 255 - i, i / 2);
+    }
+
+    /* Self check */
+
+    const float ranges[][2] = { { MIN_DB, MAX_DB }, { -130.0f, -60.0f }, { -100.5f, -99.7f }, { -73.0f, -20.0f } };
+    uint32_t    boundary = 0;
+
+    for (uint16_t i = 0; i < sizeof(ranges) / sizeof(ranges[0]); i++) {
+        if (check_range(ranges[i][0], ranges[i][1], &boundary)) {
+            return 1;
+        }
+    }
+
+    /* Timing */
+
+    uint64_t start = now_ns();
+
+    for (uint32_t n = 0; n < rows; n++) {
+        row_baseline(row, psd, WATERFALL_NFFT, MIN_DB, MAX_DB);
+    }
+
+    uint64_t baseline_ns = now_ns() - start;
+
+    start = now_ns();
+
+    for (uint32_t n = 0; n < rows; n++) {
+        wf_quantize_scalar(ids, psd, WATERFALL_NFFT, MIN_DB, MAX_DB, 1, 255);
+    }
+
+    uint64_t scalar_ns = now_ns() - start;
+
+    start = now_ns();
+
+    for (uint32_t n = 0; n < rows; n++) {
+        wf_quantize(ids, psd, WATERFALL_NFFT, MIN_DB, MAX_DB, 1, 255);
+    }
+
+    uint64_t quantize_ns = now_ns() - start;
+
+    start = now_ns();
+
+    for (uint32_t n = 0; n < rows; n++) {
+        wf_palette_row(row, psd, WATERFALL_NFFT, MIN_DB, MAX_DB, palette, 1, 255, true);
+    }
+
+    uint64_t row_ns = now_ns() - start;
+
+    printf("self check:       ok, %u bins off by one at a step boundary\n", boundary);
+    printf("rows:             %u x %u bins\n", rows, WATERFALL_NFFT);
+    printf("baseline row:     %8.0f ns/row\n", (double) baseline_ns / rows);
+    printf("quantize scalar:  %8.0f ns/row\n", (double) scalar_ns / rows);
+    printf("quantize:         %8.0f ns/row\n", (double) quantize_ns / rows);
+    printf("palette row:      %8.0f ns/row (%.1fx)\n", (double) row_ns / rows, (double) baseline_ns / row_ns);
+
+    return 0;
+}
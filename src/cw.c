@@ -58,6 +58,8 @@ static pthread_mutex_t  cw_mutex = PTHREAD_MUTEX_INITIALIZER;
 static void dds_dec_init();
 
 void cw_init() {
+    cw_decoder_init();
+
     input_cbuf = cbuffercf_create(10000);
     dds_dec_init();
     wrms = wrms_create(16, 4);
@@ -14,6 +14,7 @@
 #include "pannel.h"
 
 #define HIST_SIZE       10
+#define MORSE_TREE      (1 << (CW_MORSE_MAX + 1))
 
 static uint32_t debounce_factor = 15;
 static uint32_t thr_mean = 139;
@@ -50,7 +51,12 @@ static float    compare_factor = 2.0;
 
 static bool     character_step = false;
 static bool     word_step = false;
-static char     elements[128];
+static uint16_t elements = CW_MORSE_EMPTY;
+
+/* Characters indexed by the Morse code, see cw_morse_push() */
+
+static const char   *morse_tree[MORSE_TREE];
+static bool         morse_tree_ready = false;
 
 cw_characters_t cw_characters[] = {
     { .morse = ".-",        .character = "A" },
@@ -125,9 +131,44 @@ cw_characters_t cw_characters[] = {
 };
 
 void cw_decoder_init() {
+    if (morse_tree_ready) {
+        return;
+    }
+
+    cw_characters_t *character = &cw_characters[0];
+
+    while (character->morse) {
+        uint16_t code = CW_MORSE_EMPTY;
+
+        for (char *c = character->morse; *c; c++) {
+            code = cw_morse_push(code, *c == '-');
+        }
+
+        /* First entry wins, as with the string scan */
+
+        if (code && !morse_tree[code]) {
+            morse_tree[code] = character->character;
+        }
+
+        character++;
+    }
+
+    morse_tree_ready = true;
 }
 
-static void cw_decoder_ans(char *ans) {
+uint16_t cw_morse_push(uint16_t code, bool dah) {
+    if (code == 0 || code >= MORSE_TREE / 2) {
+        return 0;
+    }
+
+    return (code << 1) | dah;
+}
+
+const char * cw_morse_lookup(uint16_t code) {
+    return code < MORSE_TREE ? morse_tree[code] : NULL;
+}
+
+static void cw_decoder_ans(const char *ans) {
     pannel_add_text(ans);
 }
 
@@ -135,18 +176,9 @@ static void cw_decoder_wpm(uint16_t wpm) {
 }
 
 static void cw_decoder_dict() {
-    cw_characters_t *character = &cw_characters[0];
+    const char *character = cw_morse_lookup(elements);
 
-    while (character->morse) {
-        if (strcmp(elements, character->morse) == 0) {
-            cw_decoder_ans(character->character);
-            return;
-        }
-        
-        character++;
-    }
-
-    cw_decoder_ans("<?>");
+    cw_decoder_ans(character ? character : "<?>");
 }
 
 static void cw_decoder_calc_wpm() {
@@ -225,7 +257,7 @@ static void cw_decoder_inner_space() {
         
         if (character_step) {
             cw_decoder_dict();
-            strcpy(elements, "");
+            elements = CW_MORSE_EMPTY;
 
             character_step = false;
         }
@@ -285,13 +317,9 @@ void cw_decoder_signal(bool on, float ms) {
             space_duration_ref = time_track;
             word_space_duration_ref = time_track;
 
-            /* Classify and add most likely Dots or Dashes to a string for eventual character decoding */
+            /* Classify and add most likely Dots or Dashes to the code for eventual character decoding */
             
-            if (key_line_event_new <= thr_mean) {
-                strcat(elements, ".");
-            } else {
-                strcat(elements, "-");
-            }
+            elements = cw_morse_push(elements, key_line_event_new > thr_mean);
             
             character_step = true;
             word_step = true;
@@ -8,8 +8,18 @@
 
 #pragma once
 
+#include <stdint.h>
 #include <stdbool.h>
 
+/*
+ * Morse code packed in bits: a leading 1 followed by the elements, dit is 0
+ * and dah is 1 ("-.-" is 0b1101). Codes of up to CW_MORSE_MAX elements index
+ * the character table directly, 0 marks a code too long for any character.
+ */
+
+#define CW_MORSE_EMPTY  1
+#define CW_MORSE_MAX    9
+
 typedef struct {
     char    *morse;
     char    *character;
@@ -19,3 +29,6 @@ extern cw_characters_t cw_characters[];
 
 void cw_decoder_init();
 void cw_decoder_signal(bool on, float ms);
+
+uint16_t cw_morse_push(uint16_t code, bool dah);
+const char * cw_morse_lookup(uint16_t code);
@@ -14,6 +14,8 @@
 #include "params/params.h"
 #include "radio.h"
 #include "audio.h"
+#include "pcm.h"
+#include "dsp.h"
 #include "keyboard.h"
 #include "events.h"
 #include "buttons.h"
@@ -34,6 +36,9 @@
 #include "ft8/encode.h"
 #include "ft8/crc.h"
 #include "gfsk.h"
+#include "ft8_pool.h"
+#include "ft8_wf.h"
+#include "ft8_slot.h"
 #include "adif.h"
 #include "qso_log.h"
 
@@ -71,12 +76,8 @@
 #define DECIM           4
 #define SAMPLE_RATE     (AUDIO_CAPTURE_RATE / DECIM)
 
-#define MIN_SCORE       10
-#define MAX_CANDIDATES  120
-#define LDPC_ITER       20
-#define MAX_DECODED     50
-#define FREQ_OSR        2
-#define TIME_OSR        4
+#define FT8_TX_LATE_MS  1000    /* TX may start that late into its slot, DT stays well inside what decoders search */
+#define FT4_TX_LATE_MS  500
 
 #define WIDTH           771
 
@@ -218,36 +219,30 @@ static float                *waterfall_psd;
 static uint8_t              waterfall_fps_ms = (1000 / 5);
 static uint64_t             waterfall_time;
 
-static pthread_mutex_t      audio_mutex = PTHREAD_MUTEX_INITIALIZER;
-static cbuffercf            audio_buf;
+static audio_ring_reader_t  audio_reader;
 static pthread_t            thread;
+static bool                 thread_run = false;
 
 static firdecim_crcf        decim;
 static float complex        *decim_buf;
-static complex float        *rx_window = NULL;
-static complex float        *time_buf;
-static complex float        *freq_buf;
-static windowcf             frame_window;
-static fftplan              fft;
 
+static float                slot_time;
+static uint16_t             tx_late_ms;
 static float                symbol_period;
 static uint32_t             block_size;
-static uint32_t             subblock_size;
-static uint16_t             nfft;
-static waterfall_t          wf;
-
-static candidate_t          candidate_list[MAX_CANDIDATES];
-static message_t            decoded[MAX_DECODED];
-static message_t*           decoded_hashtable[MAX_DECODED];
+static ft8_wf_t             ft8_wf;
+static ft8_slot_t           ft8_slot;
+static gfsk_t               gfsk;
+static waterfall_t          *wf;
 
 static adif_log             ft8_log;
 
 static void construct_cb(lv_obj_t *parent);
 static void key_cb(lv_event_t * e);
 static void destruct_cb();
-static void audio_cb(unsigned int n, float complex *samples);
 static void rotary_cb(int32_t diff);
 static void * decode_thread(void *arg);
+static void decoded_cb(const ft8_job_t *job, void *user);
 
 static void show_cq_cb(lv_event_t * e);
 static void show_all_cb(lv_event_t * e);
@@ -295,7 +290,7 @@ static dialog_t             dialog = {
     .run = false,
     .construct_cb = construct_cb,
     .destruct_cb = destruct_cb,
-    .audio_cb = audio_cb,
+    .audio_cb = NULL,
     .rotary_cb = rotary_cb,
     .key_cb = key_cb
 };
@@ -361,68 +356,31 @@ static bool active_qso() {
     return qso_item.remote_callsign[0] != 0;
 }
 
-static void reset() {
-    wf.num_blocks = 0;
-}
-
 static void init() {
     /* FT8 decoder */
 
-    float   slot_time;
-
     switch (params.ft8_protocol) {
         case PROTO_FT4:
             slot_time = FT4_SLOT_TIME;
             symbol_period = FT4_SYMBOL_PERIOD;
+            tx_late_ms = FT4_TX_LATE_MS;
             break;
 
         case PROTO_FT8:
             slot_time = FT8_SLOT_TIME;
             symbol_period = FT8_SYMBOL_PERIOD;
+            tx_late_ms = FT8_TX_LATE_MS;
             break;
     }
 
-    block_size = SAMPLE_RATE * symbol_period;
-    subblock_size = block_size / TIME_OSR;
-    nfft = block_size * FREQ_OSR;
-
-    const uint32_t max_blocks = slot_time / symbol_period;
-    const uint32_t num_bins = SAMPLE_RATE * symbol_period / 2;
+    gfsk = gfsk_create(params.ft8_protocol == PROTO_FT4 ? FT4_SYMBOL_BT : FT8_SYMBOL_BT, symbol_period);
 
-    size_t mag_size = max_blocks * TIME_OSR * FREQ_OSR * num_bins * sizeof(uint8_t);
-
-    wf.max_blocks = max_blocks;
-    wf.num_bins = num_bins;
-    wf.time_osr = TIME_OSR;
-    wf.freq_osr = FREQ_OSR;
-    wf.block_stride = TIME_OSR * FREQ_OSR * num_bins;
-    wf.mag = (uint8_t *) malloc(mag_size);
-    wf.protocol = params.ft8_protocol;
-
-    /* FT8 DSP */
+    ft8_wf = ft8_wf_create(params.ft8_protocol, SAMPLE_RATE, FT8_SLOT_TIME_OSR, FT8_SLOT_FREQ_OSR);
+    ft8_slot = ft8_slot_create(ft8_wf, decoded_cb, NULL);
+    wf = ft8_wf_waterfall(ft8_wf);
+    block_size = ft8_wf_block_size(ft8_wf);
 
     decim_buf = (float complex *) malloc(block_size * sizeof(float complex));
-    time_buf = (float complex*) malloc(nfft * sizeof(float complex));
-    freq_buf = (float complex*) malloc(nfft * sizeof(float complex));
-    fft = fft_create_plan(nfft, time_buf, freq_buf, LIQUID_FFT_FORWARD, 0);
-    frame_window = windowcf_create(nfft);
-
-    rx_window = malloc(nfft * sizeof(complex float));
-
-    for (uint16_t i = 0; i < nfft; i++)
-        rx_window[i] = liquid_hann(i, nfft);
-
-    float gain = 0.0f;
-
-    for (uint16_t i = 0; i < nfft; i++)
-        gain += rx_window[i] * rx_window[i];
-
-    gain = 1.0f / sqrtf(gain);
-
-    for (uint16_t i = 0; i < nfft; i++)
-        rx_window[i] *= gain;
-
-    reset();
 
     struct timespec now;
     clock_gettime(CLOCK_REALTIME, &now);
@@ -438,6 +396,9 @@ static void init() {
 
     /* Worker */
 
+    ft8_pool_init();
+    audio_reader = audio_ring_reader_create(dsp_audio_ring(), "FT8");
+    thread_run = true;
     pthread_create(&thread, NULL, decode_thread, NULL);
 
     /* Logger */
@@ -445,25 +406,32 @@ static void init() {
 }
 
 static void done() {
+    /*
+     * Not canceled: the thread takes the capture ring and playback locks, which the
+     * PulseAudio callbacks take too. It sees the flag within a ring wait timeout,
+     * after the current decoding pass, or after TX is aborted
+     */
+
+    bool tx = state == TX_PROCESS;
+
+    thread_run = false;
     state = RX_PROCESS;
 
-    pthread_cancel(thread);
+    if (tx) {
+        audio_play_cancel();
+    }
+
     pthread_join(thread, NULL);
     radio_set_modem(false);
-    pthread_mutex_unlock(&audio_mutex);
-
-    free(wf.mag);
-    windowcf_destroy(frame_window);
+    audio_ring_reader_destroy(audio_reader);
 
+    ft8_slot_destroy(ft8_slot);
+    ft8_wf_destroy(ft8_wf);
+    gfsk_destroy(gfsk);
     free(decim_buf);
-    free(time_buf);
-    free(freq_buf);
-    fft_destroy_plan(fft);
 
     spgramcf_destroy(waterfall_sg);
     free(waterfall_psd);
-
-    free(rx_window);
     adif_log_close(ft8_log);
     clear_qso();
     tx_msg[0] = 0;
@@ -501,55 +469,12 @@ void static waterfall_process(float complex *frame, const size_t size) {
             &waterfall_psd[low_bin]);
 
         lv_waterfall_add_data(waterfall, &waterfall_psd[low_bin], high_bin - low_bin);
-        event_send(waterfall, LV_EVENT_REFRESH, NULL);
 
         waterfall_time = now;
         spgramcf_reset(waterfall_sg);
     }
 }
 
-void static process(float complex *frame) {
-    if (wf.num_blocks >= wf.max_blocks) {
-        LV_LOG_ERROR("FT8 wf is full");
-        return;
-    }
-    complex float   *frame_ptr;
-    int             offset = wf.num_blocks * wf.block_stride;
-    int             frame_pos = 0;
-    float           scaled_offset = 300.0f + 40.0f * log10f(2.0f / nfft);
-
-    for (int time_sub = 0; time_sub < wf.time_osr; time_sub++) {
-        windowcf_write(frame_window, &frame[frame_pos], subblock_size);
-        frame_pos += subblock_size;
-
-        windowcf_read(frame_window, &frame_ptr);
-
-        liquid_vectorcf_mul(rx_window, frame_ptr, nfft, time_buf);
-
-        fft_execute(fft);
-
-        for (int freq_sub = 0; freq_sub < wf.freq_osr; freq_sub++)
-            for (int bin = 0; bin < wf.num_bins; bin++) {
-                int             src_bin = (bin * wf.freq_osr) + freq_sub;
-                complex float   freq = freq_buf[src_bin];
-                float           v = crealf(freq * conjf(freq));
-                float           db = 10.0f * log10f(v);
-                int             scaled = (int16_t) (db * 2.0f + scaled_offset);
-
-                if (scaled < 0) {
-                    scaled = 0;
-                } else if (scaled > 255) {
-                    scaled = 255;
-                }
-
-                wf.mag[offset] = scaled;
-                offset++;
-            }
-    }
-
-    wf.num_blocks++;
-}
-
 static void add_msg_cb(lv_event_t * e) {
     cell_data_t *cell_data = (cell_data_t *) lv_event_get_param(e);
     uint16_t    row = 0;
@@ -559,7 +484,7 @@ static void add_msg_cb(lv_event_t * e) {
     lv_table_get_selected_cell(table, &row, &col);
     scroll = table_rows == (row + 1);
 
-    // Copy data, because original event data will be deleted
+    // Copy data, because event data lives in the queue slot
     cell_data_t *cell_data_copy = malloc(sizeof(cell_data_t));
     *cell_data_copy = *cell_data;
 #ifdef MAX_TABLE_MSG
@@ -715,7 +640,6 @@ static void destruct_cb() {
     done();
 
     firdecim_crcf_destroy(decim);
-    free(audio_buf);
 
     mem_load(MEM_BACKUP_ID);
 
@@ -744,7 +668,7 @@ static void load_band() {
 }
 
 static void clean() {
-    reset();
+    ft8_slot_reset(ft8_slot);
 
     lv_table_set_row_cnt(table, 0);
     lv_table_set_row_cnt(table, 1);
@@ -861,7 +785,6 @@ static void construct_cb(lv_obj_t *parent) {
     lv_obj_add_event_cb(dialog.obj, band_cb, EVENT_BAND_DOWN, NULL);
 
     decim = firdecim_crcf_create_kaiser(DECIM, 16, 40.0f);
-    audio_buf = cbuffercf_create(AUDIO_CAPTURE_RATE * 3);
 
     /* Waterfall */
 
@@ -1063,6 +986,7 @@ static void tx_cq_dis_cb(lv_event_t * e) {
 
     if (state == TX_PROCESS) {
         state = RX_PROCESS;
+        audio_play_cancel();
     }
     cq_enabled = false;
     tx_enabled = false;
@@ -1117,18 +1041,11 @@ static void tx_call_dis_cb(lv_event_t * e) {
 
     if (state == TX_PROCESS) {
         state = RX_PROCESS;
+        audio_play_cancel();
     }
     tx_enabled = false;
 }
 
-static void audio_cb(unsigned int n, float complex *samples) {
-    if (state == RX_PROCESS) {
-        pthread_mutex_lock(&audio_mutex);
-        cbuffercf_write(audio_buf, samples, n);
-        pthread_mutex_unlock(&audio_mutex);
-    }
-}
-
 
 static void time_sync(lv_event_t * e) {
     time_t now = time(NULL);
@@ -1259,38 +1176,34 @@ static void tx_worker() {
     }
 
     const uint16_t signal_freq = 1325;
-    uint32_t    n_samples = 0;
-    float       symbol_bt = (params.ft8_protocol == PROTO_FT4) ? FT4_SYMBOL_BT : FT8_SYMBOL_BT;
-    int16_t     *samples = gfsk_synth(tones, n_tones, signal_freq, symbol_bt, symbol_period, &n_samples);
-    int16_t     *ptr = samples;
+    int16_t     samples[1024 * 2];
     size_t      part;
 
+    gfsk_start(gfsk, tones, n_tones, signal_freq);
+
     // Change freq before tx
     uint64_t    radio_freq = params_band_cur_freq_get();
 
     radio_set_freq(radio_freq + params.ft8_tx_freq.x - signal_freq);
     radio_set_modem(true);
 
-    float gain_scale = -8.2f + params.ft8_output_gain_offset + log10f(LV_MIN(params.pwr, MAX_PWR)) * 5;
+    float gain_scale = pcm_db_scale(-8.2f + params.ft8_output_gain_offset + log10f(LV_MIN(params.pwr, MAX_PWR)) * 5);
 
     while (true) {
-        if (n_samples <= 0 || state != TX_PROCESS) {
+        part = (state == TX_PROCESS && thread_run) ? gfsk_read(gfsk, samples, 1024 * 2) : 0;
+
+        if (part == 0) {
             state = RX_PROCESS;
             break;
         }
-        part = LV_MIN(1024 * 2, n_samples);
-        audio_gain_db(ptr, part, gain_scale, ptr);
-        audio_play(ptr, part);
-
-        n_samples -= part;
-        ptr += part;
+        pcm_gain(samples, samples, part, gain_scale);
+        audio_play(samples, part);
     }
 
     audio_play_wait();
     radio_set_modem(false);
     // Restore freq
     radio_set_freq(radio_freq);
-    free(samples);
 }
 
 /**
@@ -1364,26 +1277,24 @@ static msg_t parse_rx_msg(const char * str) {
  */
 static void add_info(const char * fmt, ...) {
     va_list     args;
-    cell_data_t  *cell_data = malloc(sizeof(cell_data_t));
-    cell_data->cell_type = CELL_RX_INFO;
+    cell_data_t cell_data = { .cell_type = CELL_RX_INFO };
 
     va_start(args, fmt);
-    vsnprintf(cell_data->text, sizeof(cell_data->text), fmt, args);
+    vsnprintf(cell_data.text, sizeof(cell_data.text), fmt, args);
     va_end(args);
 
-    event_send(table, EVENT_FT8_MSG, cell_data);
+    event_send_data(table, EVENT_FT8_MSG, &cell_data, sizeof(cell_data));
 }
 
 /**
  * Add TX message to the table
  */
 static void add_tx_text(const char * text) {
-    cell_data_t  *cell_data = malloc(sizeof(cell_data_t));
-    cell_data->cell_type = CELL_TX_MSG;
+    cell_data_t cell_data = { .cell_type = CELL_TX_MSG };
 
-    strncpy(cell_data->text, text, sizeof(cell_data->text) - 1);
+    strncpy(cell_data.text, text, sizeof(cell_data.text) - 1);
 
-    event_send(table, EVENT_FT8_MSG, cell_data);
+    event_send_data(table, EVENT_FT8_MSG, &cell_data, sizeof(cell_data));
 }
 
 /**
@@ -1394,8 +1305,6 @@ static void add_rx_text(int16_t snr, const char * text, bool odd) {
     ft8_cell_type_t cell_type;
 
     msg_t msg = parse_rx_msg(text);
-    msg_t * msg_p = malloc(sizeof(msg_t));
-    *msg_p = msg;
 
     if (str_equal(msg.call_to, params.callsign.x)) {
         cell_type = CELL_RX_TO_ME;
@@ -1404,10 +1313,10 @@ static void add_rx_text(int16_t snr, const char * text, bool odd) {
             strncpy(qso_item.remote_callsign, msg.call_from, sizeof(qso_item.remote_callsign) - 1);
         }
         if (active_qso() && (msg.type != MSG_TYPE_73) && str_equal(msg.call_from, qso_item.remote_callsign)) {
-            if (qso_item.last_rx_msg != NULL) {
-                free(qso_item.last_rx_msg);
+            if (qso_item.last_rx_msg == NULL) {
+                qso_item.last_rx_msg = malloc(sizeof(msg_t));
             }
-            qso_item.last_rx_msg = msg_p;
+            *qso_item.last_rx_msg = msg;
             qso_item.last_snr = snr;
             qso_item.rx_odd = odd;
             if (msg.type == MSG_TYPE_GRID) {
@@ -1424,104 +1333,100 @@ static void add_rx_text(int16_t snr, const char * text, bool odd) {
     } else {
         cell_type = CELL_RX_MSG;
     }
-    cell_data_t  *cell_data = malloc(sizeof(cell_data_t));
+    cell_data_t cell_data = { 0 };
+
     if (msg.type == MSG_TYPE_CQ) {
-        cell_data->worked_type = qso_log_search_worked(
+        cell_data.worked_type = qso_log_search_worked(
             msg.call_from,
             params.ft8_protocol == PROTO_FT8 ? MODE_FT8 : MODE_FT4,
             qso_log_freq_to_band(params_band_cur_freq_get())
         );
     }
 
-    cell_data->cell_type = cell_type;
-    strncpy(cell_data->text, text, sizeof(cell_data->text) - 1);
-    cell_data->msg = msg;
-    cell_data->local_snr = snr;
-    cell_data->odd = odd;
+    cell_data.cell_type = cell_type;
+    strncpy(cell_data.text, text, sizeof(cell_data.text) - 1);
+    cell_data.msg = msg;
+    cell_data.local_snr = snr;
+    cell_data.odd = odd;
     if (params.qth.x[0] != 0) {
         const char *qth = find_qth(text);
 
-        cell_data->dist = qth ? grid_dist(qth) : 0;
+        cell_data.dist = qth ? grid_dist(qth) : 0;
     } else {
-        cell_data->dist = 0;
+        cell_data.dist = 0;
     }
-    event_send(table, EVENT_FT8_MSG, cell_data);
+    event_send_data(table, EVENT_FT8_MSG, &cell_data, sizeof(cell_data));
 }
 
-static void decode(bool odd) {
-    uint16_t    num_candidates = ft8_find_sync(&wf, MAX_CANDIDATES, candidate_list, MIN_SCORE);
-
-    memset(decoded_hashtable, 0, sizeof(decoded_hashtable));
-    memset(decoded, 0, sizeof(decoded));
-
-    for (uint16_t idx = 0; idx < num_candidates; idx++) {
-        const candidate_t *cand = &candidate_list[idx];
+/**
+ * Time (get_time() ms) when decoding of the slot of slot_odd must be done. The TX/answer
+ * decision for the next slot is made right after it, and TX may start up to tx_late_ms
+ * into that slot. The full waterfall is ready only ~0.1 s before the slot end, so
+ * the time past the slot end is most of the budget
+ */
+static uint64_t slot_deadline(bool slot_odd) {
+    struct timespec now;
 
-        if (cand->score < MIN_SCORE)
-            continue;
+    clock_gettime(CLOCK_REALTIME, &now);
 
-        float freq_hz = (cand->freq_offset + (float) cand->freq_sub / wf.freq_osr) / symbol_period;
-        float time_sec = (cand->time_offset + (float) cand->time_sub / wf.time_osr) * symbol_period;
+    float   sec = (now.tv_sec % 60) + now.tv_nsec / 1000000000.0f;
+    int32_t left_ms = tx_late_ms - fmodf(sec, slot_time) * 1000.0f;
 
-        message_t       message;
-        decode_status_t status;
+    /* Still in the decoded slot (audio comes in time), its end is ahead */
 
-        if (!ft8_decode(&wf, cand, &message, LDPC_ITER, &status)) {
-            continue;
-        }
+    if (get_time_slot(now) == slot_odd) {
+        left_ms += slot_time * 1000.0f;
+    }
 
-        uint16_t    idx_hash = message.hash % MAX_DECODED;
-        bool        found_empty_slot = false;
-        bool        found_duplicate = false;
+    return get_time() + (left_ms > 0 ? left_ms : 0);
+}
 
-        do {
-            if (decoded_hashtable[idx_hash] == NULL) {
-                found_empty_slot = true;
-            } else if (decoded_hashtable[idx_hash]->hash == message.hash && strcmp(decoded_hashtable[idx_hash]->text, message.text) == 0) {
-                found_duplicate = true;
-            } else {
-                idx_hash = (idx_hash + 1) % MAX_DECODED;
-            }
-        } while (!found_empty_slot && !found_duplicate);
+/**
+ * New message of the slot, rx_worker() runs for the slot of odd
+ */
+static void decoded_cb(const ft8_job_t *job, void *user) {
+    add_rx_text(job->cand.snr, job->message.text, odd);
+}
 
-        if (found_empty_slot) {
-            memcpy(&decoded[idx_hash], &message, sizeof(message));
-            decoded_hashtable[idx_hash] = &decoded[idx_hash];
+/**
+ * Decode the slot of slot_odd, in time for the TX decision of the next one
+ */
+static void decode(bool slot_odd) {
+    uint64_t    deadline = slot_deadline(slot_odd);
+    uint8_t     passes = params.ft8_multipass.x ? FT8_SLOT_PASSES : 1;
+    uint8_t     done = ft8_slot_decode(ft8_slot, deadline, passes, params.ft8_osd.x ? FT8_SLOT_OSD_DEPTH : 0);
+    int32_t     left_ms = (int64_t) deadline - (int64_t) get_time();
 
-            add_rx_text(cand->snr, message.text, odd);
-        }
-    }
+    LV_LOG_INFO("Slot decoded in %u of %u passes, %d ms left", done, passes, (int) left_ms);
 }
 
 static void rx_worker(bool new_slot, bool odd) {
-    unsigned int    n;
     float complex   *buf;
     const size_t    size = block_size * DECIM;
 
-    pthread_mutex_lock(&audio_mutex);
-
-    while (cbuffercf_size(audio_buf) > size) {
-        cbuffercf_read(audio_buf, size, &buf, &n);
-
+    while (audio_ring_peek(audio_reader, &buf, size) == size) {
         firdecim_crcf_execute_block(decim, buf, block_size, decim_buf);
-        cbuffercf_release(audio_buf, size);
+        audio_ring_release(audio_reader, size);
 
         waterfall_process(decim_buf, block_size);
 
-        process(decim_buf);
+        if (!ft8_wf_process(ft8_wf, decim_buf)) {
+            LV_LOG_ERROR("FT8 wf is full");
+        }
 
-        if (wf.num_blocks >= wf.max_blocks) {
+        if (wf->num_blocks >= wf->max_blocks) {
             decode(odd);
-            reset();
+            ft8_slot_reset(ft8_slot);
+        } else if (params.ft8_early.x) {
+            ft8_slot_early(ft8_slot);
         }
     }
-    pthread_mutex_unlock(&audio_mutex);
 
     if (new_slot) {
-        if (wf.num_blocks > (wf.max_blocks * 0.75f)) {
+        if (wf->num_blocks > (wf->max_blocks * 0.75f)) {
             decode(odd);
         }
-        reset();
+        ft8_slot_reset(ft8_slot);
     }
 }
 
@@ -1552,16 +1457,13 @@ static void generate_tx_msg() {
 }
 
 static void * decode_thread(void *arg) {
-    pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
-    pthread_setcanceltype(PTHREAD_CANCEL_ASYNCHRONOUS, NULL);
-
     struct timespec now;
     bool            new_odd;
     struct tm       *ts;
     bool            new_slot=false;
     bool            have_tx_msg=false;
 
-    while (true) {
+    while (thread_run) {
         clock_gettime(CLOCK_REALTIME, &now);
         new_odd = get_time_slot(now);
         new_slot = new_odd != odd;
@@ -1577,6 +1479,9 @@ static void * decode_thread(void *arg) {
                 state = TX_PROCESS;
                 add_tx_text(tx_msg);
                 tx_worker();
+
+                /* Own TX is not for decoding */
+                audio_ring_skip(audio_reader);
                 if (!active_qso() && !cq_enabled) {
                     tx_msg[0] = 0;
                 }
@@ -1589,7 +1494,7 @@ static void * decode_thread(void *arg) {
                 }
             }
         } else {
-            usleep(30000);
+            audio_ring_wait(audio_reader, block_size * DECIM, 30);
         }
         odd = new_odd;
     }
@@ -20,6 +20,7 @@
 #include <aether_radio/x6100_control/control.h>
 
 #include "audio.h"
+#include "pcm.h"
 #include "dialog.h"
 #include "dialog_msg_voice.h"
 #include "styles.h"
@@ -177,12 +178,14 @@ static void play_item() {
     }
 
     state = MSG_VOICE_PLAY;
+    float gain_scale = pcm_db_scale(params.play_gain_db);
+
     while (state == MSG_VOICE_PLAY) {
         int res = sf_read_short(file, samples_buf, BUF_SIZE);
 
         if (res > 0) {
             if (params.play_gain_db != 0) {
-                audio_gain_db(samples_buf, res, params.play_gain_db, samples_buf);
+                pcm_gain(samples_buf, samples_buf, res, gain_scale);
             }
 
             audio_play(samples_buf, res);
@@ -195,9 +198,13 @@ static void play_item() {
     audio_play_wait();
 }
 
+/*
+ * Playing threads hold PulseAudio and playback locks, so they are stopped by
+ * audio_play_cancel() and never canceled there. Only the beacon pause can be canceled
+ */
+
 static void * play_thread(void *arg) {
-    pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
-    pthread_setcanceltype(PTHREAD_CANCEL_ASYNCHRONOUS, NULL);
+    pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
 
     audio_play_en(true);
     play_item();
@@ -210,8 +217,7 @@ static void * play_thread(void *arg) {
 }
 
 static void * send_thread(void *arg) {
-    pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
-    pthread_setcanceltype(PTHREAD_CANCEL_ASYNCHRONOUS, NULL);
+    pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
 
     msg_set_text_fmt("Sending message");
 
@@ -226,14 +232,15 @@ static void * send_thread(void *arg) {
 }
 
 static void * beacon_thread(void *arg) {
-    pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
-    pthread_setcanceltype(PTHREAD_CANCEL_ASYNCHRONOUS, NULL);
+    pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
 
     while (true) {
         switch (beacon) {
             case VOICE_BEACON_OFF:
-                buttons_unload_page();
-                buttons_load_page(PAGE_MSG_VOICE_1);
+                if (dialog.run) {
+                    buttons_unload_page();
+                    buttons_load_page(PAGE_MSG_VOICE_1);
+                }
                 return NULL;
 
             case VOICE_BEACON_PLAY:
@@ -245,7 +252,10 @@ static void * beacon_thread(void *arg) {
 
             case VOICE_BEACON_IDLE:
                 msg_set_text_fmt("Beacon pause: %i s", params.voice_msg_period);
+
+                pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
                 sleep(params.voice_msg_period);
+                pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
                 break;
         }
 
@@ -262,6 +272,19 @@ static void * beacon_thread(void *arg) {
     return NULL;
 }
 
+/**
+ * Stop beacon in pause. Cancel wakes it from the sleep, if it just went to play, stop the playback
+ */
+static void beacon_thread_stop() {
+    beacon = VOICE_BEACON_OFF;
+    pthread_cancel(thread);
+
+    state = MSG_VOICE_OFF;
+    audio_play_cancel();
+
+    pthread_join(thread, NULL);
+}
+
 static void textarea_window_close_cb() {
     lv_group_add_obj(keyboard_group, table);
     lv_group_set_editing(keyboard_group, true);
@@ -292,9 +315,7 @@ static void textarea_window_edit_ok_cb() {
 
 static void tx_cb(lv_event_t * e) {
     if (beacon == VOICE_BEACON_IDLE) {
-        pthread_cancel(thread);
-        pthread_join(thread, NULL);
-        beacon = VOICE_BEACON_OFF;
+        beacon_thread_stop();
 
         buttons_unload_page();
         buttons_load_page(PAGE_MSG_VOICE_1);
@@ -342,8 +363,11 @@ static void destruct_cb() {
     audio_play_en(false);
 
     if (beacon == VOICE_BEACON_IDLE) {
-        pthread_cancel(thread);
-        pthread_join(thread, NULL);
+        beacon_thread_stop();
+    }
+
+    if (state == MSG_VOICE_PLAY) {
+        audio_play_cancel();
     }
 
     beacon = VOICE_BEACON_OFF;
@@ -382,6 +406,7 @@ void dialog_msg_voice_send_cb(lv_event_t * e) {
 
 static void send_stop_cb(lv_event_t * e) {
     state = MSG_VOICE_OFF;
+    audio_play_cancel();
 }
 
 void dialog_msg_voice_beacon_cb(lv_event_t * e) {
@@ -399,9 +424,7 @@ void dialog_msg_voice_beacon_cb(lv_event_t * e) {
 static void beacon_stop_cb(lv_event_t * e) {
     switch (state) {
         case MSG_VOICE_OFF:
-            pthread_cancel(thread);
-            pthread_join(thread, NULL);
-            beacon = VOICE_BEACON_OFF;
+            beacon_thread_stop();
 
             buttons_unload_page();
             buttons_load_page(PAGE_MSG_VOICE_1);
@@ -410,6 +433,7 @@ static void beacon_stop_cb(lv_event_t * e) {
         case MSG_VOICE_PLAY:
             beacon = VOICE_BEACON_OFF;
             state = MSG_VOICE_OFF;
+            audio_play_cancel();
             break;
 
         default:
@@ -507,27 +531,26 @@ msg_voice_state_t dialog_msg_voice_get_state() {
 }
 
 void dialog_msg_voice_put_audio_samples(size_t nsamples, int16_t *samples) {
-    int16_t *out_samples;
-    if (params.rec_gain_db != 0) {
-        out_samples = malloc(nsamples * sizeof(*out_samples));
-        audio_gain_db(samples, nsamples, params.rec_gain_db, out_samples);
-    } else {
-        out_samples = samples;
-    }
-    int16_t peak = 0;
+    int16_t     buf[BUF_SIZE];
+    float       gain_scale = pcm_db_scale(params.rec_gain_db);
+    uint16_t    peak = 0;
 
-    for (uint16_t i = 0; i < nsamples; i++) {
-        int16_t x = abs(out_samples[i]);
+    while (nsamples) {
+        size_t      part = LV_MIN(nsamples, BUF_SIZE);
+        int16_t     *out_samples = samples;
 
-        if (x > peak) {
-            peak = x;
+        if (params.rec_gain_db != 0) {
+            pcm_gain(buf, samples, part, gain_scale);
+            out_samples = buf;
         }
-    }
 
-    peak = S1 + (peak / 32768.0) * (S9_40 - S1);
-    meter_update(peak, 0.25f);
-    sf_write_short(file, out_samples, nsamples);
-    if (params.rec_gain_db != 0) {
-        free(out_samples);
+        peak = LV_MAX(peak, pcm_peak(out_samples, part));
+        sf_write_short(file, out_samples, part);
+
+        samples += part;
+        nsamples -= part;
     }
+
+    int16_t db = S1 + (peak / 32768.0) * (S9_40 - S1);
+    meter_update(db, 0.25f);
 }
@@ -18,6 +18,7 @@
 #include <aether_radio/x6100_control/control.h>
 
 #include "audio.h"
+#include "pcm.h"
 #include "recorder.h"
 #include "dialog.h"
 #include "dialog_recorder.h"
@@ -147,12 +148,14 @@ static void play_item() {
 
     play_state = true;
 
+    float gain_scale = pcm_db_scale(params.play_gain_db);
+
     while (play_state) {
         int res = sf_read_short(file, samples_buf, BUF_SIZE);
 
         if (res > 0) {
             if (params.play_gain_db != 0) {
-                audio_gain_db(samples_buf, res, params.play_gain_db, samples_buf);
+                pcm_gain(samples_buf, samples_buf, res, gain_scale);
             }
 
             audio_play(samples_buf, res);
@@ -166,8 +169,8 @@ static void play_item() {
 }
 
 static void * play_thread(void *arg) {
-    pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
-    pthread_setcanceltype(PTHREAD_CANCEL_ASYNCHRONOUS, NULL);
+    /* Stopped by audio_play_cancel(), canceling it could leave playback locks held */
+    pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
 
     audio_play_en(true);
     play_item();
@@ -210,6 +213,7 @@ static void textarea_window_edit_ok_cb() {
 static void tx_cb(lv_event_t * e) {
     if (play_state) {
         play_state = false;
+        audio_play_cancel();
 
         buttons_unload_page();
         buttons_load_page(PAGE_RECORDER);
@@ -301,7 +305,11 @@ static void construct_cb(lv_obj_t *parent) {
 
 static void destruct_cb() {
     audio_play_en(false);
-    play_state = false;
+
+    if (play_state) {
+        play_state = false;
+        audio_play_cancel();
+    }
     textarea_window_close();
     lv_timer_del(level_timer);
 }
@@ -344,6 +352,7 @@ void dialog_recorder_play_cb(lv_event_t * e) {
 
 void play_stop_cb(lv_event_t * e) {
     play_state = false;
+    audio_play_cancel();
 }
 
 void dialog_recorder_rename_cb(lv_event_t * e) {
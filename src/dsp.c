@@ -10,6 +10,8 @@
 #include <stdbool.h>
 #include <pthread.h>
 #include <math.h>
+#include <string.h>
+#include <time.h>
 
 #include "dsp.h"
 #include "spectrum.h"
@@ -22,7 +24,11 @@
 #include "rtty.h"
 #include "dialog_ft8.h"
 #include "dialog_msg_voice.h"
-#include "recorder.h"
+#include "render.h"
+#include "pcm.h"
+#include "hilbert.h"
+
+#define DEMOD_BLOCK     4096    /* Chunk for CW and RTTY input buffers */
 
 static iirfilt_cccf     dc_block;
 
@@ -37,28 +43,60 @@ static spgramcf         spectrum_sg_tx;
 static float            *spectrum_psd;
 static float            *spectrum_psd_filtered;
 static float            spectrum_beta = 0.7f;
-static uint8_t          spectrum_fps_ms = (1000 / 15);
-static uint64_t         spectrum_time;
 static float complex    *spectrum_dec_buf;
 
 static spgramcf         waterfall_sg_rx;
 static spgramcf         waterfall_sg_tx;
 static float            *waterfall_psd;
-static uint8_t          waterfall_fps_ms = (1000 / 25);
-static uint64_t         waterfall_time;
+static float            min_max_buf[WATERFALL_NFFT];
 
 static float complex    buf_filtered[RADIO_SAMPLES];
 
 static uint8_t          psd_delay;
 static uint8_t          min_max_delay;
 
-static firhilbf         audio_hilb;
-static float complex    *audio;
+static hilbert_t        audio_hilb;
+static float            *audio_real;
+static audio_ring_t     audio_ring;
+static pthread_t        demod_thread;
+static bool             demod_run = false;
 
 static bool             ready = false;
 
 static void dsp_update_min_max(float *data_buf, uint16_t size);
 static void setup_spectrum_spgram();
+static void * demod_worker(void *arg);
+
+/* Profiling */
+
+static const char *stage_names[DSP_STAGE_LAST] = {
+    "dc_block", "decim", "spectrum_sg", "waterfall_sg",
+    "spectrum_psd", "waterfall_psd", "s_meter", "min_max"
+};
+
+#ifdef DSP_PROFILE
+
+static dsp_stage_stat_t stats[DSP_STAGE_LAST];
+
+static uint64_t stage_start() {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint64_t) now.tv_sec * 1000000000L + now.tv_nsec;
+}
+
+static void stage_end(dsp_stage_t stage, uint64_t start) {
+    stats[stage].ns += stage_start() - start;
+    stats[stage].calls++;
+}
+
+#else
+
+#define stage_start()           0
+#define stage_end(stage, start) (void) (start)
+
+#endif
 
 /* * */
 
@@ -78,13 +116,22 @@ void dsp_init(uint8_t factor) {
 
     waterfall_psd = malloc(WATERFALL_NFFT * sizeof(float));
 
-    spectrum_time = get_time();
-    waterfall_time = get_time();
+    render_init();
 
     psd_delay = 4;
 
-    audio = (float complex *) malloc(AUDIO_CAPTURE_RATE * sizeof(float complex));
-    audio_hilb = firhilbf_create(7, 60.0f);
+    audio_real = (float *) malloc(AUDIO_CAPTURE_RATE * sizeof(float));
+    audio_hilb = hilbert_create(7, 60.0f);
+    audio_ring = audio_ring_create(AUDIO_RING_SIZE, AUDIO_RING_GUARD);
+
+    demod_run = true;
+
+    int err = pthread_create(&demod_thread, NULL, demod_worker, NULL);
+
+    if (err) {
+        demod_run = false;
+        LV_LOG_ERROR("Can't start demod thread: %s", strerror(err));
+    }
 
     ready = true;
 }
@@ -102,38 +149,56 @@ static void process_samples(
     firdecim_crcf sp_decim, spgramcf sp_sg,
     spgramcf wf_sg
 ) {
+    uint64_t t = stage_start();
+
     iirfilt_cccf_execute_block(dc_block, buf_samples, size, buf_filtered);
+    stage_end(DSP_STAGE_DC_BLOCK, t);
 
     if (spectrum_factor > 1) {
+        t = stage_start();
         firdecim_crcf_execute_block(sp_decim, buf_filtered, size / spectrum_factor, spectrum_dec_buf);
+        stage_end(DSP_STAGE_DECIM, t);
+
+        t = stage_start();
         spgramcf_write(sp_sg, spectrum_dec_buf, size / spectrum_factor);
+        stage_end(DSP_STAGE_SPECTRUM_SG, t);
     } else {
+        t = stage_start();
         spgramcf_write(sp_sg, buf_filtered, size);
+        stage_end(DSP_STAGE_SPECTRUM_SG, t);
     }
 
+    t = stage_start();
     spgramcf_write(wf_sg, buf_filtered, size);
+    stage_end(DSP_STAGE_WATERFALL_SG, t);
 }
 
 static bool update_spectrum(spgramcf sp_sg, uint64_t now, bool tx) {
-    if ((now - spectrum_time > spectrum_fps_ms) && (!psd_delay)) {
+    if (!psd_delay && render_due(RENDER_SPECTRUM, now)) {
+        uint64_t t = stage_start();
+
         spgramcf_get_psd(sp_sg, spectrum_psd);
         liquid_vectorf_addscalar(spectrum_psd, SPECTRUM_NFFT, -30.0f, spectrum_psd);
         // Decrease beta for high zoom
         float new_beta = powf(spectrum_beta, ((float) spectrum_factor - 1.0f) / 2.0f + 1.0f);
         lpf_block(spectrum_psd_filtered, spectrum_psd, new_beta, SPECTRUM_NFFT);
+        stage_end(DSP_STAGE_SPECTRUM_PSD, t);
+
         spectrum_data(spectrum_psd_filtered, SPECTRUM_NFFT, tx);
-        spectrum_time = now;
         return true;
     }
     return false;
 }
 
 static bool update_waterfall(spgramcf wf_sg, uint64_t now, bool tx) {
-    if ((now - waterfall_time > waterfall_fps_ms) && (!psd_delay)) {
+    if (!psd_delay && render_due(RENDER_WATERFALL, now)) {
+        uint64_t t = stage_start();
+
         spgramcf_get_psd(wf_sg, waterfall_psd);
         liquid_vectorf_addscalar(waterfall_psd, WATERFALL_NFFT, -30.0f, waterfall_psd);
+        stage_end(DSP_STAGE_WATERFALL_PSD, t);
+
         waterfall_data(waterfall_psd, WATERFALL_NFFT, tx);
-        waterfall_time = now;
         return true;
     }
     return false;
@@ -185,10 +250,15 @@ void dsp_samples(float complex *buf_samples, uint16_t size, bool tx) {
     pthread_mutex_unlock(&spectrum_mux);
     update_spectrum(sp_sg, now, tx);
     if (update_waterfall(wf_sg, now, tx)) {
+        uint64_t t = stage_start();
+
         update_s_meter();
+        stage_end(DSP_STAGE_S_METER, t);
         // TODO: skip on disabled auto min/max
         if (!tx) {
+            t = stage_start();
             dsp_update_min_max(waterfall_psd, WATERFALL_NFFT);
+            stage_end(DSP_STAGE_MIN_MAX, t);
         } else {
             min_max_delay = 2;
         }
@@ -255,29 +325,66 @@ void dsp_put_audio_samples(size_t nsamples, int16_t *samples) {
         return;
     }
 
-    if (recorder_is_on()) {
-        recorder_put_audio_samples(nsamples, samples);
-    }
+    pcm_to_float(audio_real, samples, nsamples);
 
-    for (uint16_t i = 0; i < nsamples; i++)
-        firhilbf_r2c_execute(audio_hilb, samples[i] / 32768.0f, &audio[i]);
+    /* Consumers read the analytic signal from the ring in their own threads */
 
-    x6100_mode_t    mode = radio_current_mode();
+    for (size_t pos = 0; pos < nsamples;) {
+        float complex   *audio;
+        size_t          n = audio_ring_reserve(audio_ring, &audio, nsamples - pos);
 
-    if (rtty_get_state() == RTTY_RX) {
-        rtty_put_audio_samples(nsamples, audio);
-    } else if (mode == x6100_mode_cw || mode == x6100_mode_cwr) {
-        cw_put_audio_samples(nsamples, audio);
-    } else {
-        dialog_audio_samples(nsamples, audio);
+        hilbert_execute(audio_hilb, audio_real + pos, n, audio);
+        audio_ring_commit(audio_ring, n);
+        pos += n;
     }
 }
 
-static int compare_fft(const void *p1, const void *p2) {
-    float *i1 = (float *) p1;
-    float *i2 = (float *) p2;
+/**
+ * Stop and join the demod consumer, it notices the flag within one wait timeout
+ */
+void dsp_demod_stop() {
+    if (!demod_run) {
+        return;
+    }
+
+    demod_run = false;
+    pthread_join(demod_thread, NULL);
+}
+
+audio_ring_t dsp_audio_ring() {
+    return audio_ring;
+}
+
+/**
+ * CW, RTTY and dialog consumer of the capture audio
+ */
+static void * demod_worker(void *arg) {
+    audio_ring_reader_t reader = audio_ring_reader_create(audio_ring, "Demod");
+
+    while (demod_run) {
+        float complex   *audio;
+        size_t          n;
+
+        audio_ring_wait(reader, 1, 100);
+
+        while ((n = audio_ring_peek(reader, &audio, DEMOD_BLOCK)) > 0) {
+            x6100_mode_t    mode = radio_current_mode();
+
+            if (rtty_get_state() == RTTY_RX) {
+                rtty_put_audio_samples(n, audio);
+            } else if (mode == x6100_mode_cw || mode == x6100_mode_cwr) {
+                cw_put_audio_samples(n, audio);
+            } else {
+                dialog_audio_samples(n, audio);
+            }
 
-    return (*i1 < *i2) ? -1 : 1;
+            audio_ring_release(reader, n);
+        }
+    }
+
+    audio_ring_reader_destroy(reader);
+
+    return NULL;
 }
 
 static void dsp_update_min_max(float *data_buf, uint16_t size) {
@@ -285,13 +392,19 @@ static void dsp_update_min_max(float *data_buf, uint16_t size) {
         min_max_delay--;
         return;
     }
-    qsort(data_buf, size, sizeof(float), compare_fft);
     uint16_t    min_nth = 15;
     uint16_t    max_nth = 10;
 
-    float       min = data_buf[min_nth];
-    float       max = data_buf[size - max_nth - 1];
+    /* Select on a private copy, the PSD itself stays in bin order */
+
+    memcpy(min_max_buf, data_buf, size * sizeof(float));
+
+    float       min = select_nth(min_max_buf, size, min_nth);
+
+    /* Everything above min_nth is already >= min, search only there */
 
+    uint16_t    upper = min_nth + 1;
+    float       max = select_nth(min_max_buf + upper, size - upper, size - max_nth - 1 - upper);
 
     if (max > S9_40) {
         max = S9_40;
@@ -311,6 +424,24 @@ static void dsp_update_min_max(float *data_buf, uint16_t size) {
     waterfall_update_max(max);
 }
 
+const char * dsp_stage_name(dsp_stage_t stage) {
+    return stage_names[stage];
+}
+
+void dsp_stats_get(dsp_stage_stat_t *out) {
+#ifdef DSP_PROFILE
+    memcpy(out, stats, sizeof(stats));
+#else
+    memset(out, 0, DSP_STAGE_LAST * sizeof(dsp_stage_stat_t));
+#endif
+}
+
+void dsp_stats_reset() {
+#ifdef DSP_PROFILE
+    memset(stats, 0, sizeof(stats));
+#endif
+}
+
 static void setup_spectrum_spgram() {
     if (spectrum_sg_rx) {
         spgramcf_destroy(spectrum_sg_rx);
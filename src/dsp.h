@@ -9,15 +9,43 @@
 #pragma once
 
 #include <stdint.h>
+#include <stdbool.h>
 #include <stdlib.h>
 #include <liquid/liquid.h>
 
+#include "audio_ring.h"
+
 #define WATERFALL_NFFT  1024
 #define SPECTRUM_NFFT   800
 
+#define AUDIO_RING_SIZE     (1 << 17)   /* About 3 s of capture audio */
+#define AUDIO_RING_GUARD    (1 << 13)   /* Max contiguous read, FT8 needs 7056 */
+
+/* Per-stage timing, collected only when built with DSP_PROFILE */
+
+typedef enum {
+    DSP_STAGE_DC_BLOCK = 0,
+    DSP_STAGE_DECIM,
+    DSP_STAGE_SPECTRUM_SG,
+    DSP_STAGE_WATERFALL_SG,
+    DSP_STAGE_SPECTRUM_PSD,
+    DSP_STAGE_WATERFALL_PSD,
+    DSP_STAGE_S_METER,
+    DSP_STAGE_MIN_MAX,
+
+    DSP_STAGE_LAST
+} dsp_stage_t;
+
+typedef struct {
+    uint64_t    ns;
+    uint32_t    calls;
+} dsp_stage_stat_t;
+
 void dsp_init(uint8_t factor);
+audio_ring_t dsp_audio_ring();
 void dsp_samples(float complex *buf_samples, uint16_t size, bool tx);
 void dsp_reset();
+void dsp_demod_stop();
 
 void dsp_set_spectrum_factor(uint8_t x);
 
@@ -25,3 +53,7 @@ float dsp_get_spectrum_beta();
 void dsp_set_spectrum_beta(float x);
 
 void dsp_put_audio_samples(size_t nsamples, int16_t *samples);
+
+const char * dsp_stage_name(dsp_stage_t stage);
+void dsp_stats_get(dsp_stage_stat_t *stats);
+void dsp_stats_reset();
@@ -7,12 +7,15 @@
  */
 
 #include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
 #include <pthread.h>
 #include "events.h"
 #include "backlight.h"
 #include "keyboard.h"
 
-#define QUEUE_SIZE  64
+#define QUEUE_SIZE      64
+#define PAYLOAD_SIZE    256
 
 uint32_t        EVENT_ROTARY;
 uint32_t        EVENT_KEYPAD;
@@ -29,13 +32,22 @@ uint32_t        EVENT_GPS;
 uint32_t        EVENT_BAND_UP;
 uint32_t        EVENT_BAND_DOWN;
 
+/*
+ * Items live in a static pool, payloads up to PAYLOAD_SIZE are copied inline.
+ * A slot is released by the consumer only after dispatch, so producers never
+ * overwrite the param of an event that LVGL is still handling.
+ */
+
 typedef struct {
     lv_obj_t        *obj;
     lv_event_code_t event_code;
     void            *param;
+    bool            taken;
+    bool            heap;
+    uint8_t         payload[PAYLOAD_SIZE] __attribute__((aligned(8)));
 } item_t;
 
-static item_t           *queue[QUEUE_SIZE];
+static item_t           queue[QUEUE_SIZE];
 static uint8_t          queue_write = 0;
 static uint8_t          queue_read = 0;
 static pthread_mutex_t  queue_mux;
@@ -56,65 +68,146 @@ void event_init() {
     EVENT_BAND_UP = lv_event_register_id();
     EVENT_BAND_DOWN = lv_event_register_id();
 
-    for (uint8_t i = 0; i < QUEUE_SIZE; i++)
-        queue[i] = NULL;
-
     pthread_mutex_init(&queue_mux, NULL);
 }
 
 void event_obj_check() {
-    while (queue_read != queue_write) {
+    while (true) {
         pthread_mutex_lock(&queue_mux);
-        queue_read = (queue_read + 1) % QUEUE_SIZE;
 
-        item_t *item = queue[queue_read];
-        queue[queue_read] = NULL;
+        if (queue_read == queue_write) {
+            pthread_mutex_unlock(&queue_mux);
+            break;
+        }
+
+        uint8_t next = (queue_read + 1) % QUEUE_SIZE;
+        item_t  *item = &queue[next];
+
+        item->taken = true;
         pthread_mutex_unlock(&queue_mux);
 
-        if (item) {
-            if (item->event_code == LV_EVENT_REFRESH) {
-                if (backlight_is_on()) {
-                    lv_obj_invalidate(item->obj);
-                }
-            } else {
-                lv_event_send(item->obj, item->event_code, item->param);
+        if (item->event_code == LV_EVENT_REFRESH) {
+            if (backlight_is_on()) {
+                lv_obj_invalidate(item->obj);
             }
+        } else {
+            lv_event_send(item->obj, item->event_code, item->param);
+        }
 
-            if (item->param != NULL) {
-                free(item->param);
-            }
+        if (item->heap) {
+            free(item->param);
+        }
+
+        pthread_mutex_lock(&queue_mux);
+        queue_read = next;
+        pthread_mutex_unlock(&queue_mux);
+    }
+}
 
-            free(item);
+/**
+ * Refresh of an object is idempotent, merge it with a pending one
+ */
+static bool refresh_pending(lv_obj_t *obj) {
+    for (uint8_t i = queue_read; i != queue_write;) {
+        i = (i + 1) % QUEUE_SIZE;
+
+        item_t *item = &queue[i];
+
+        if (!item->taken && item->obj == obj && item->event_code == LV_EVENT_REFRESH) {
+            return true;
         }
     }
+
+    return false;
+}
+
+/**
+ * Take next free slot, queue_mux must be locked. Pending items are (queue_read, queue_write],
+ * so the queue is full with QUEUE_SIZE - 1 of them: the next one would make it look empty
+ */
+static item_t * item_get(lv_obj_t *obj, lv_event_code_t event_code) {
+    uint8_t next = (queue_write + 1) % QUEUE_SIZE;
+    item_t  *item = &queue[next];
+
+    if (next == queue_read) {
+        return NULL;
+    }
+
+    item->obj = obj;
+    item->event_code = event_code;
+    item->param = NULL;
+    item->taken = false;
+    item->heap = false;
+
+    return item;
 }
 
+static void item_put(item_t *item) {
+    queue_write = item - queue;
+}
+
+/**
+ * Queue event for LVGL thread. Non NULL param must be allocated by malloc and will be freed after dispatch
+ */
 void event_send(lv_obj_t *obj, lv_event_code_t event_code, void *param) {
     pthread_mutex_lock(&queue_mux);
 
-    uint8_t next = (queue_write + 1) % QUEUE_SIZE;
+    if (event_code == LV_EVENT_REFRESH && param == NULL && refresh_pending(obj)) {
+        pthread_mutex_unlock(&queue_mux);
+        return;
+    }
+
+    item_t *item = item_get(obj, event_code);
 
-    if (queue[next]) {
+    if (!item) {
         pthread_mutex_unlock(&queue_mux);
         LV_LOG_ERROR("Overflow");
+        free(param);
         return;
     }
 
-    item_t *item = malloc(sizeof(item_t));
-
-    item->obj = obj;
-    item->event_code = event_code;
     item->param = param;
+    item->heap = param != NULL;
+    item_put(item);
 
-    queue[next] = item;
-    queue_write = next;
+    pthread_mutex_unlock(&queue_mux);
+}
+
+/**
+ * Queue event with a copy of data. Small data is kept in the queue slot, without allocation
+ */
+void event_send_data(lv_obj_t *obj, lv_event_code_t event_code, const void *data, size_t size) {
+    void *copy = NULL;
+
+    if (size > PAYLOAD_SIZE) {
+        copy = malloc(size);
+        memcpy(copy, data, size);
+    }
+
+    pthread_mutex_lock(&queue_mux);
+
+    item_t *item = item_get(obj, event_code);
+
+    if (!item) {
+        pthread_mutex_unlock(&queue_mux);
+        LV_LOG_ERROR("Overflow");
+        free(copy);
+        return;
+    }
+
+    if (copy) {
+        item->param = copy;
+        item->heap = true;
+    } else {
+        memcpy(item->payload, data, size);
+        item->param = item->payload;
+    }
+
+    item_put(item);
 
     pthread_mutex_unlock(&queue_mux);
 }
 
 void event_send_key(int32_t key) {
-    int32_t *c = malloc(sizeof(int32_t));
-    *c = key;
-
-    event_send(lv_group_get_focused(keyboard_group), LV_EVENT_KEY, c);
+    event_send_data(lv_group_get_focused(keyboard_group), LV_EVENT_KEY, &key, sizeof(key));
 }
@@ -139,4 +139,5 @@ void event_init();
 
 void event_obj_check();
 void event_send(lv_obj_t *obj, lv_event_code_t event_code, void *param);
+void event_send_data(lv_obj_t *obj, lv_event_code_t event_code, const void *data, size_t size);
 void event_send_key(int32_t key);
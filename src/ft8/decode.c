@@ -3,10 +3,17 @@
 #include "crc.h"
 #include "ldpc.h"
 #include "unpack.h"
+#include "encode.h"
 
 #include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
 #include <math.h>
 
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
 /// Compute log likelihood log(p(1) / p(0)) of 174 message bits for later use in soft-decision LDPC decoding
 /// @param[in] wf Waterfall data collected during message slot
 /// @param[in] cand Candidate to extract the message from
@@ -22,6 +29,9 @@ static void ft8_extract_likelihood(const waterfall_t* wf, const candidate_t* can
 /// @param[out] packed Byte-packed bits representing the data in bit_array
 static void pack_bits(const uint8_t bit_array[], int num_bits, uint8_t packed[]);
 
+/// CRC check and unpacking of a codeword that satisfies parity checks
+static bool ftx_check_message(const waterfall_t* wf, const uint8_t plain174[], message_t* message, decode_status_t* status);
+
 static float max2(float a, float b);
 static float max4(float a, float b, float c, float d);
 static void heapify_down(candidate_t heap[], int heap_size);
@@ -32,8 +42,6 @@ static void ft4_extract_symbol(const uint8_t* wf, float* logl);
 static void ft8_extract_symbol(const uint8_t* wf, float* logl);
 static void ft8_decode_multi_symbols(const uint8_t* wf, int num_bins, int n_syms, int bit_idx, float* log174);
 
-int get_snr(const waterfall_t* wf, candidate_t candidate);
-
 static int get_index(const waterfall_t* wf, const candidate_t* candidate)
 {
     int offset = candidate->time_offset;
@@ -43,178 +51,348 @@ static int get_index(const waterfall_t* wf, const candidate_t* candidate)
     return offset;
 }
 
-static int ft8_sync_score(const waterfall_t* wf, const candidate_t* candidate)
+// Sync search layout of the protocol: Costas groups and tones
+typedef struct
+{
+    int num_sync;          ///< Number of sync groups
+    int length_sync;       ///< Length of each sync group
+    int sync_offset;       ///< Offset between sync groups
+    int first_block;       ///< Block of the first sync symbol
+    int max_tone;          ///< Highest tone index
+    const uint8_t* costas; ///< Costas tones, length_sync per group
+    int costas_stride;     ///< Step of costas between groups (0 if all groups are the same)
+} sync_layout_t;
+
+static const sync_layout_t kFT8_sync_layout = { FT8_NUM_SYNC, FT8_LENGTH_SYNC, FT8_SYNC_OFFSET, 0, 7, kFT8_Costas_pattern, 0 };
+static const sync_layout_t kFT4_sync_layout = { FT4_NUM_SYNC, FT4_LENGTH_SYNC, FT4_SYNC_OFFSET, 1, 3, &kFT4_Costas_pattern[0][0], FT4_LENGTH_SYNC };
+
+// Time offsets of sync search, in blocks
+#define SYNC_MIN_OFFSET (-12)
+#define SYNC_MAX_OFFSET (24)
+
+// Frequency bins are scored in chunks, this is also the granularity of pruning
+#define SYNC_CHUNK (16)
+
+// Maximum number of terms (sync symbol components) in the score of one time offset
+#define SYNC_MAX_TERMS (3 * FT8_NUM_SYNC * FT8_LENGTH_SYNC)
+
+/// Differences of one (time_sub, freq_sub) plane of the waterfall, computed in one sweep.
+/// Sync score of every candidate is a sum of these rows, with no per-candidate branching.
+typedef struct
+{
+    int16_t* lo;   ///< p[b] - p[b - 1], prominence over the lower neighbour bin
+    int16_t* hi;   ///< p[b] - p[b + 1], prominence over the upper neighbour bin
+    int16_t* peak; ///< lo + hi
+    int16_t* rise; ///< p[b] - p[b] of the previous block
+} sync_plane_t;
+
+static void sync_plane_build(const waterfall_t* wf, int time_sub, int freq_sub, sync_plane_t* plane)
+{
+    int num_bins = wf->num_bins;
+
+    for (int block = 0; block < wf->num_blocks; ++block)
+    {
+        const uint8_t* p = wf->mag + ((block * wf->time_osr + time_sub) * wf->freq_osr + freq_sub) * num_bins;
+        int16_t* lo = plane->lo + block * num_bins;
+        int16_t* hi = plane->hi + block * num_bins;
+        int16_t* peak = plane->peak + block * num_bins;
+        int16_t* rise = plane->rise + block * num_bins;
+
+        lo[0] = 0;
+        for (int b = 1; b < num_bins; ++b)
+        {
+            lo[b] = p[b] - p[b - 1];
+        }
+        for (int b = 0; b < num_bins - 1; ++b)
+        {
+            hi[b] = p[b] - p[b + 1];
+        }
+        hi[num_bins - 1] = 0;
+        for (int b = 0; b < num_bins; ++b)
+        {
+            peak[b] = lo[b] + hi[b];
+        }
+
+        if (block == 0)
+        {
+            memset(rise, 0, num_bins * sizeof(rise[0]));
+        }
+        else
+        {
+            const uint8_t* prev = p - wf->block_stride;
+            for (int b = 0; b < num_bins; ++b)
+            {
+                rise[b] = p[b] - prev[b];
+            }
+        }
+    }
+}
+
+/// Collect terms of the sync score of a time offset, same as the per candidate score of the reference decoder:
+/// each sync symbol is compared with the neighbour tones and with the same tone of the neighbour blocks.
+/// @return Number of averaged differences
+static int sync_terms(const waterfall_t* wf, const sync_layout_t* layout, const sync_plane_t* plane, int time_offset,
+    const int16_t* plus[], int* num_plus, const int16_t* minus[], int* num_minus)
 {
-    int score = 0;
     int num_average = 0;
 
-    // Get the pointer to symbol 0 of the candidate
-    const uint8_t* mag_cand = wf->mag + get_index(wf, candidate);
+    *num_plus = 0;
+    *num_minus = 0;
 
-    // Compute average score over sync symbols (m+k = 0-7, 36-43, 72-79)
-    for (int m = 0; m < FT8_NUM_SYNC; ++m)
+    for (int m = 0; m < layout->num_sync; ++m)
     {
-        for (int k = 0; k < FT8_LENGTH_SYNC; ++k)
+        for (int k = 0; k < layout->length_sync; ++k)
         {
-            int block = (FT8_SYNC_OFFSET * m) + k;          // relative to the message
-            int block_abs = candidate->time_offset + block; // relative to the captured signal
+            int block = layout->first_block + (layout->sync_offset * m) + k; // relative to the message
+            int block_abs = time_offset + block;                              // relative to the captured signal
             // Check for time boundaries
             if (block_abs < 0)
                 continue;
             if (block_abs >= wf->num_blocks)
                 break;
 
-            // Get the pointer to symbol 'block' of the candidate
-            const uint8_t* p8 = mag_cand + (block * wf->block_stride);
-
-            // Weighted difference between the expected and all other symbols
-            // Does not work as well as the alternative score below
-            // score += 8 * p8[kFT8_Costas_pattern[k]] -
-            //          p8[0] - p8[1] - p8[2] - p8[3] -
-            //          p8[4] - p8[5] - p8[6] - p8[7];
-            // ++num_average;
+            int sm = layout->costas[layout->costas_stride * m + k]; // Index of the expected bin
+            int row = block_abs * wf->num_bins + sm;                // Candidate bin 0 is at column 0
 
-            // Check only the neighbors of the expected symbol frequency- and time-wise
-            int sm = kFT8_Costas_pattern[k]; // Index of the expected bin
-            if (sm > 0)
+            if ((sm > 0) && (sm < layout->max_tone))
             {
-                // look at one frequency bin lower
-                score += p8[sm] - p8[sm - 1];
+                plus[(*num_plus)++] = plane->peak + row;
+                num_average += 2;
+            }
+            else if (sm > 0)
+            {
+                plus[(*num_plus)++] = plane->lo + row;
                 ++num_average;
             }
-            if (sm < 7)
+            else
             {
-                // look at one frequency bin higher
-                score += p8[sm] - p8[sm + 1];
+                plus[(*num_plus)++] = plane->hi + row;
                 ++num_average;
             }
+
             if ((k > 0) && (block_abs > 0))
             {
-                // look one symbol back in time
-                score += p8[sm] - p8[sm - wf->block_stride];
+                // one symbol back in time
+                plus[(*num_plus)++] = plane->rise + row;
                 ++num_average;
             }
-            if (((k + 1) < FT8_LENGTH_SYNC) && ((block_abs + 1) < wf->num_blocks))
+            if (((k + 1) < layout->length_sync) && ((block_abs + 1) < wf->num_blocks))
             {
-                // look one symbol forward in time
-                score += p8[sm] - p8[sm + wf->block_stride];
+                // one symbol forward in time
+                minus[(*num_minus)++] = plane->rise + row + wf->num_bins;
                 ++num_average;
             }
         }
     }
 
-    if (num_average > 0)
-        score /= num_average;
-
-    return score;
+    return num_average;
 }
 
-static int ft4_sync_score(const waterfall_t* wf, const candidate_t* candidate)
+/// Sum score terms over a chunk of SYNC_CHUNK frequency bins starting at f
+static void sync_sum_chunk(int16_t* sum, int f, const int16_t* plus[], int num_plus, const int16_t* minus[], int num_minus)
 {
-    int score = 0;
-    int num_average = 0;
+#if defined(__ARM_NEON)
+    int16x8_t acc0 = vdupq_n_s16(0);
+    int16x8_t acc1 = vdupq_n_s16(0);
+
+    for (int i = 0; i < num_plus; ++i)
+    {
+        acc0 = vaddq_s16(acc0, vld1q_s16(plus[i] + f));
+        acc1 = vaddq_s16(acc1, vld1q_s16(plus[i] + f + 8));
+    }
+    for (int i = 0; i < num_minus; ++i)
+    {
+        acc0 = vsubq_s16(acc0, vld1q_s16(minus[i] + f));
+        acc1 = vsubq_s16(acc1, vld1q_s16(minus[i] + f + 8));
+    }
 
-    // Get the pointer to symbol 0 of the candidate
-    const uint8_t* mag_cand = wf->mag + get_index(wf, candidate);
+    vst1q_s16(sum + f, acc0);
+    vst1q_s16(sum + f + 8, acc1);
+#else
+    int16_t acc[SYNC_CHUNK] = { 0 };
 
-    // Compute average score over sync symbols (block = 1-4, 34-37, 67-70, 100-103)
-    for (int m = 0; m < FT4_NUM_SYNC; ++m)
+    for (int i = 0; i < num_plus; ++i)
     {
-        for (int k = 0; k < FT4_LENGTH_SYNC; ++k)
+        const int16_t* p = plus[i] + f;
+        for (int j = 0; j < SYNC_CHUNK; ++j)
         {
-            int block = 1 + (FT4_SYNC_OFFSET * m) + k;
-            int block_abs = candidate->time_offset + block;
-            // Check for time boundaries
-            if (block_abs < 0)
-                continue;
-            if (block_abs >= wf->num_blocks)
-                break;
+            acc[j] += p[j];
+        }
+    }
+    for (int i = 0; i < num_minus; ++i)
+    {
+        const int16_t* p = minus[i] + f;
+        for (int j = 0; j < SYNC_CHUNK; ++j)
+        {
+            acc[j] -= p[j];
+        }
+    }
 
-            // Get the pointer to symbol 'block' of the candidate
-            const uint8_t* p4 = mag_cand + (block * wf->block_stride);
+    memcpy(sum + f, acc, sizeof(acc));
+#endif
+}
 
-            int sm = kFT4_Costas_pattern[m][k]; // Index of the expected bin
+static void heap_push(candidate_t heap[], int* heap_size, int num_candidates, const candidate_t* candidate)
+{
+    // If the heap is full AND the current candidate is better than
+    // the worst in the heap, we remove the worst and make space
+    if (*heap_size == num_candidates && candidate->score > heap[0].score)
+    {
+        heap[0] = heap[*heap_size - 1];
+        --(*heap_size);
+        heapify_down(heap, *heap_size);
+    }
 
-            // score += (4 * p4[sm]) - p4[0] - p4[1] - p4[2] - p4[3];
-            // num_average += 4;
+    // If there's free space in the heap, we add the current candidate
+    if (*heap_size < num_candidates)
+    {
+        heap[*heap_size] = *candidate;
+        ++(*heap_size);
+        heapify_up(heap, *heap_size);
+    }
+}
 
-            // Check only the neighbors of the expected symbol frequency- and time-wise
-            if (sm > 0)
-            {
-                // look at one frequency bin lower
-                score += p4[sm] - p4[sm - 1];
-                ++num_average;
-            }
-            if (sm < 3)
-            {
-                // look at one frequency bin higher
-                score += p4[sm] - p4[sm + 1];
-                ++num_average;
-            }
-            if ((k > 0) && (block_abs > 0))
-            {
-                // look one symbol back in time
-                score += p4[sm] - p4[sm - wf->block_stride];
-                ++num_average;
-            }
-            if (((k + 1) < FT4_LENGTH_SYNC) && ((block_abs + 1) < wf->num_blocks))
-            {
-                // look one symbol forward in time
-                score += p4[sm] - p4[sm + wf->block_stride];
-                ++num_average;
-            }
-        }
+/// Sizes of sync search memory for a waterfall of num_blocks
+static void sync_workspace_size(const waterfall_t* wf, int num_blocks, int* buf_size, int* alive_size)
+{
+    const int num_freq = wf->num_bins - 7;
+    const int num_chunks = (num_freq > 0) ? (num_freq + SYNC_CHUNK - 1) / SYNC_CHUNK : 0;
+    const int plane_size = num_blocks * wf->num_bins + SYNC_CHUNK; // Last chunk may read past the last bin
+
+    *buf_size = 4 * plane_size + num_chunks * SYNC_CHUNK;
+    *alive_size = wf->freq_osr * (SYNC_MAX_OFFSET - SYNC_MIN_OFFSET) * num_chunks;
+}
+
+bool ft8_sync_workspace_init(sync_workspace_t* ws, const waterfall_t* wf)
+{
+    sync_workspace_size(wf, wf->max_blocks, &ws->buf_size, &ws->alive_size);
+
+    ws->buf = calloc(ws->buf_size, sizeof(int16_t));
+    ws->alive = calloc(ws->alive_size, sizeof(uint8_t));
+
+    if (!ws->buf || !ws->alive)
+    {
+        ft8_sync_workspace_free(ws);
+        return false;
     }
 
-    if (num_average > 0)
-        score /= num_average;
+    return true;
+}
 
-    return score;
+void ft8_sync_workspace_free(sync_workspace_t* ws)
+{
+    free(ws->buf);
+    free(ws->alive);
+    ws->buf = NULL;
+    ws->alive = NULL;
+    ws->buf_size = 0;
+    ws->alive_size = 0;
 }
 
-int ft8_find_sync(const waterfall_t* wf, int num_candidates, candidate_t heap[], int min_score)
+int ft8_find_sync(const waterfall_t* wf, sync_workspace_t* ws, int num_candidates, candidate_t heap[], int min_score)
 {
+    const sync_layout_t* layout = (wf->protocol == PROTO_FT4) ? &kFT4_sync_layout : &kFT8_sync_layout;
+    const int num_freq = wf->num_bins - 7;                                // Candidates have 8 bins above them
+    const int num_chunks = (num_freq + SYNC_CHUNK - 1) / SYNC_CHUNK;
+    const int num_offsets = SYNC_MAX_OFFSET - SYNC_MIN_OFFSET;
+    const int plane_size = wf->num_blocks * wf->num_bins + SYNC_CHUNK; // Last chunk may read past the last bin
+
+    if ((num_freq <= 0) || (wf->num_blocks == 0))
+    {
+        return 0;
+    }
+
+    int buf_size, alive_size;
+    sync_workspace_size(wf, wf->num_blocks, &buf_size, &alive_size);
+
+    if ((buf_size > ws->buf_size) || (alive_size > ws->alive_size))
+    {
+        return 0;
+    }
+
+    sync_plane_t plane;
+    int16_t* buf = ws->buf;
+    uint8_t* alive = ws->alive;
+
+    plane.lo = buf;
+    plane.hi = buf + plane_size;
+    plane.peak = buf + 2 * plane_size;
+    plane.rise = buf + 3 * plane_size;
+    int16_t* sum = buf + 4 * plane_size;
+
+    // Planes are written in full by sync_plane_build(), only the read-past tails and the marks need clearing
+    for (int i = 1; i <= 4; ++i)
+    {
+        memset(buf + i * plane_size - SYNC_CHUNK, 0, SYNC_CHUNK * sizeof(int16_t));
+    }
+    memset(alive, 0, alive_size);
+
+    const int16_t* plus[SYNC_MAX_TERMS];
+    const int16_t* minus[SYNC_MAX_TERMS];
     int heap_size = 0;
     candidate_t candidate;
 
     // Here we allow time offsets that exceed signal boundaries, as long as we still have all data bits.
     // I.e. we can afford to skip the first 7 or the last 7 Costas symbols, as long as we track how many
     // sync symbols we included in the score, so the score is averaged.
+    // Time subdivision 0 goes first and marks chunks where a signal may be, other subdivisions lie
+    // between two whole-block offsets and are scored only where either of them is marked.
     for (candidate.time_sub = 0; candidate.time_sub < wf->time_osr; ++candidate.time_sub)
     {
         for (candidate.freq_sub = 0; candidate.freq_sub < wf->freq_osr; ++candidate.freq_sub)
         {
-            for (candidate.time_offset = -12; candidate.time_offset < 24; ++candidate.time_offset)
+            sync_plane_build(wf, candidate.time_sub, candidate.freq_sub, &plane);
+
+            for (candidate.time_offset = SYNC_MIN_OFFSET; candidate.time_offset < SYNC_MAX_OFFSET; ++candidate.time_offset)
             {
-                for (candidate.freq_offset = 0; (candidate.freq_offset + 7) < wf->num_bins; ++candidate.freq_offset)
+                int num_plus, num_minus;
+                int num_average = sync_terms(wf, layout, &plane, candidate.time_offset, plus, &num_plus, minus, &num_minus);
+                int idx = candidate.freq_sub * num_offsets + (candidate.time_offset - SYNC_MIN_OFFSET);
+                uint8_t* mark = alive + idx * num_chunks;
+                const uint8_t* next = (candidate.time_offset + 1 < SYNC_MAX_OFFSET) ? mark + num_chunks : mark;
+
+                // score >= min_score is sum >= threshold, as score is sum / num_average truncated toward zero
+                int threshold = (min_score > 0) ? min_score * num_average : (min_score - 1) * num_average + 1;
+                // Sub-block time shifts are scored only where a whole-block offset around them has half of min_score
+                int prune_threshold = (min_score / 2) * num_average;
+
+                for (int chunk = 0; chunk < num_chunks; ++chunk)
                 {
-                    if (wf->protocol == PROTO_FT4)
-                    {
-                        candidate.score = ft4_sync_score(wf, &candidate);
-                    }
-                    else
+                    if ((candidate.time_sub > 0) && !mark[chunk] && !next[chunk])
                     {
-                        candidate.score = ft8_sync_score(wf, &candidate);
+                        continue;
                     }
 
-                    if (candidate.score < min_score)
-                        continue;
+                    int f0 = chunk * SYNC_CHUNK;
+                    int f1 = (f0 + SYNC_CHUNK < num_freq) ? f0 + SYNC_CHUNK : num_freq;
 
-                    // If the heap is full AND the current candidate is better than
-                    // the worst in the heap, we remove the worst and make space
-                    if (heap_size == num_candidates && candidate.score > heap[0].score)
-                    {
-                        heap[0] = heap[heap_size - 1];
-                        --heap_size;
-                        heapify_down(heap, heap_size);
-                    }
+                    sync_sum_chunk(sum, f0, plus, num_plus, minus, num_minus);
 
-                    // If there's free space in the heap, we add the current candidate
-                    if (heap_size < num_candidates)
+                    for (int f = f0; f < f1; ++f)
                     {
-                        heap[heap_size] = candidate;
-                        ++heap_size;
-                        heapify_up(heap, heap_size);
+                        if ((candidate.time_sub == 0) && (num_average > 0) && (sum[f] >= prune_threshold))
+                        {
+                            mark[chunk] = 1;
+                        }
+
+                        if (num_average == 0)
+                        {
+                            candidate.score = 0;
+                        }
+                        else if (sum[f] < threshold)
+                        {
+                            continue;
+                        }
+                        else
+                        {
+                            candidate.score = sum[f] / num_average;
+                        }
+
+                        if (candidate.score < min_score)
+                            continue;
+
+                        candidate.freq_offset = f;
+                        heap_push(heap, &heap_size, num_candidates, &candidate);
                     }
                 }
             }
@@ -232,76 +410,72 @@ int ft8_find_sync(const waterfall_t* wf, int num_candidates, candidate_t heap[],
         heapify_down(heap, len_unsorted);
     }
 
-    for (int i = 0; i < heap_size; i++) {
-        heap[i].snr = get_snr(wf,heap[i]);
-    }
-
     return heap_size;
 }
 
-void swap(int* xp, int* yp) {
-    int temp = *xp;
-    *xp = *yp;
-    *yp = temp;
-}
- 
-// Function to perform Selection Sort
-void selectionSort(int arr[], int n) {
-    int i, j, min_idx;
-  
-    for (i = 0; i < n-1; i++) {
-        min_idx = i;
-
-        for (j = i+1; j < n; j++)
-          if (arr[j] < arr[min_idx])
-            min_idx = j;
-  
-        swap(&arr[min_idx], &arr[i]);
-    }
-}
-
-int get_snr(const waterfall_t* wf, candidate_t candidate) {
-    //array with wf.num_blocks (row of watterfall) x 8*wf.freq_osr (signals witdh)
-    //Get this watterfall zoom on the candidate symbols
-    //Sort max to min and calculate max/min = ft8snr and return with substract of -26db for get snr on 2500hz
+/// Number of ranks [from, to) shares with ranks [rank, rank + count)
+static int rank_overlap(int rank, int count, int from, int to)
+{
+    int lo = (rank > from) ? rank : from;
+    int hi = (rank + count < to) ? rank + count : to;
 
-    int     m = wf->freq_osr * wf->time_osr;
-    int     l = 8 * m;
-    int     n = 2 * m;
-    float   freq_hz = (candidate.freq_offset + (float)candidate.freq_sub / 2) / 0.160f;
-    float   minC = 0, maxC = 0;
-    int     i = 0;
+    return (hi > lo) ? hi - lo : 0;
+}
 
-    while (i < wf->num_blocks) {
-        int candidate_zoom[l];
+int ft8_snr(const waterfall_t* wf, const candidate_t* candidate)
+{
+    // For every block take the waterfall zoom on the candidate symbols (8 * m magnitudes),
+    // average its top m as the signal and its 2m..4m lowest as the noise.
+    // Only sums of these ranks are needed, so the zoom is counted in a histogram of magnitudes
+    // instead of being sorted. The difference is scaled from 6.25 Hz bin to 2500 Hz band (-26 dB)
+
+    int m = wf->freq_osr * wf->time_osr;
+    int l = 8 * m;
+    int n = 2 * m;
+    uint16_t hist[256] = { 0 };
+    int sum_min = 0;
+    int sum_max = 0;
+
+    for (int i = 0; i < wf->num_blocks; i++)
+    {
+        const uint8_t* zoom = wf->mag + (i * wf->block_stride) + candidate->freq_offset + candidate->freq_sub;
+        uint8_t lo = 255;
+        uint8_t hi = 0;
 
-        for (int j = 0; j< 8; j++) {
-            for(int k = 0; k<m; k++) {
-                candidate_zoom[(j*m)+k] = wf->mag[( (i * wf->block_stride) + candidate.freq_offset + candidate.freq_sub + (j*m) + k )];
-            }
+        for (int j = 0; j < l; j++)
+        {
+            lo = (zoom[j] < lo) ? zoom[j] : lo;
+            hi = (zoom[j] > hi) ? zoom[j] : hi;
+        }
+        for (int j = 0; j < l; j++)
+        {
+            hist[zoom[j]]++;
         }
 
-        selectionSort(candidate_zoom,l);
+        // Walk magnitudes up, clearing the histogram for the next block
+        int rank = 0;
 
-        for (int j = 0; j < n; j++) {
-            minC += candidate_zoom[j+(n)];
-        }
+        for (int v = lo; v <= hi; v++)
+        {
+            int count = hist[v];
 
-        for (int j = 1; j <= m; j++) {
-            maxC += candidate_zoom[(l)-j];
-        }
+            if (count == 0)
+                continue;
 
-        i++;
+            sum_min += v * rank_overlap(rank, count, n, 2 * n);
+            sum_max += v * rank_overlap(rank, count, l - m, l);
+            rank += count;
+            hist[v] = 0;
+        }
     }
 
-    minC = minC / (wf->num_blocks*wf->freq_osr*wf->time_osr*2);
-    maxC = maxC / (wf->num_blocks*wf->freq_osr*wf->time_osr);
+    float min_c = (float)sum_min / (wf->num_blocks * wf->freq_osr * wf->time_osr * 2);
+    float max_c = (float)sum_max / (wf->num_blocks * wf->freq_osr * wf->time_osr);
 
-    int min = (int)(minC/2 - 240);
-    int max = (int)(maxC/2 - 240);
-    int snr= max - min - 26;
+    int min = (int)(min_c / 2 - 240);
+    int max = (int)(max_c / 2 - 240);
 
-    return snr;
+    return max - min - 26;
 }
 
 static void ft4_extract_likelihood(const waterfall_t* wf, const candidate_t* cand, float* log174)
@@ -398,8 +572,12 @@ bool ft8_decode(const waterfall_t* wf, const candidate_t* cand, message_t* messa
 
     ftx_normalize_logl(log174);
 
+    // Decoder state is reused, one per decoding thread
+    static _Thread_local ldpc_workspace_t ldpc_ws;
+
     uint8_t plain174[FTX_LDPC_N]; // message bits (0/1)
-    bp_decode(log174, max_iterations, plain174, &status->ldpc_errors);
+    ldpc_minsum_decode(&ldpc_ws, log174, max_iterations, plain174, &status->ldpc_errors);
+    // bp_decode(log174, max_iterations, plain174, &status->ldpc_errors);
     // ldpc_decode(log174, max_iterations, plain174, &status->ldpc_errors);
 
     if (status->ldpc_errors > 0)
@@ -407,6 +585,42 @@ bool ft8_decode(const waterfall_t* wf, const candidate_t* cand, message_t* messa
         return false;
     }
 
+    return ftx_check_message(wf, plain174, message, status);
+}
+
+bool ft8_decode_osd(const waterfall_t* wf, const candidate_t* cand, message_t* message, int depth, decode_status_t* status)
+{
+    float log174[FTX_LDPC_N]; // message bits encoded as likelihood
+    if (wf->protocol == PROTO_FT4)
+    {
+        ft4_extract_likelihood(wf, cand, log174);
+    }
+    else
+    {
+        ft8_extract_likelihood(wf, cand, log174);
+    }
+
+    ftx_normalize_logl(log174);
+
+    // Decoder state is reused, one per decoding thread
+    static _Thread_local ldpc_osd_workspace_t osd_ws;
+
+    uint8_t plain174[FTX_LDPC_N]; // message bits (0/1)
+    float discrepancy = ldpc_osd_decode(&osd_ws, log174, depth, plain174);
+
+    // OSD output is always a valid codeword, but too far from the channel one it is most likely noise
+    if (!ldpc_osd_reliable(log174, discrepancy))
+    {
+        return false;
+    }
+
+    status->ldpc_errors = 0;
+
+    return ftx_check_message(wf, plain174, message, status);
+}
+
+static bool ftx_check_message(const waterfall_t* wf, const uint8_t plain174[], message_t* message, decode_status_t* status)
+{
     // Extract payload + CRC (first FTX_LDPC_K bits) packed into a byte array
     uint8_t a91[FTX_LDPC_K_BYTES];
     pack_bits(plain174, FTX_LDPC_K, a91);
@@ -443,9 +657,93 @@ bool ft8_decode(const waterfall_t* wf, const candidate_t* cand, message_t* messa
     // Reuse binary message CRC as hash value for the message
     message->hash = status->crc_extracted;
 
+    memcpy(message->payload, a91, sizeof(message->payload));
+    message->payload[9] &= 0xF8;
+
     return true;
 }
 
+void ft8_subtract(waterfall_t* wf, const candidate_t* cand, const message_t* message)
+{
+    uint8_t tones[FT4_NN]; // FT4_NN > FT8_NN
+    int num_symbols;
+
+    if (wf->protocol == PROTO_FT4)
+    {
+        ft4_encode(message->payload, tones);
+        num_symbols = FT4_NN;
+    }
+    else
+    {
+        ft8_encode(message->payload, tones);
+        num_symbols = FT8_NN;
+    }
+
+    // Waterfall as a grid of fine time rows and fine frequency columns
+    int num_rows = wf->num_blocks * wf->time_osr;
+    int num_cols = wf->num_bins * wf->freq_osr;
+    int row0 = cand->time_offset * wf->time_osr + cand->time_sub;
+    int col0 = cand->freq_offset * wf->freq_osr + cand->freq_sub;
+
+    // Noise floor: median of the symbol rows over the whole band, where other signals are a minority
+    uint32_t hist[256] = { 0 };
+    uint32_t count = 0;
+
+    for (int i = 0; i < num_symbols; ++i)
+    {
+        int row = row0 + i * wf->time_osr;
+        if ((row < 0) || (row >= num_rows))
+        {
+            continue;
+        }
+        const uint8_t* p = &wf->mag[row * wf->freq_osr * wf->num_bins];
+        for (int col = 0; col < num_cols; ++col)
+        {
+            ++hist[p[col]];
+        }
+        count += num_cols;
+    }
+
+    if (count == 0)
+    {
+        return;
+    }
+
+    int noise = 0;
+    uint32_t sum = hist[0];
+    while (sum * 2 < count)
+    {
+        sum += hist[++noise];
+    }
+
+    // Clip the tones, with leakage to neighbour time and frequency subdivisions
+    for (int i = 0; i < num_symbols; ++i)
+    {
+        int row_c = row0 + i * wf->time_osr;
+        int col_c = col0 + tones[i] * wf->freq_osr;
+
+        for (int row = row_c - (wf->time_osr - 1); row <= row_c + (wf->time_osr - 1); ++row)
+        {
+            if ((row < 0) || (row >= num_rows))
+            {
+                continue;
+            }
+            for (int col = col_c - (wf->freq_osr - 1); col <= col_c + (wf->freq_osr - 1); ++col)
+            {
+                if ((col < 0) || (col >= num_cols))
+                {
+                    continue;
+                }
+                uint8_t* p = &wf->mag[((row * wf->freq_osr) + (col % wf->freq_osr)) * wf->num_bins + (col / wf->freq_osr)];
+                if (*p > noise)
+                {
+                    *p = noise;
+                }
+            }
+        }
+    }
+}
+
 static float max2(float a, float b)
 {
     return (a >= b) ? a : b;
@@ -38,7 +38,7 @@ extern "C"
         int16_t freq_offset; ///< Index of the frequency bin
         uint8_t time_sub;    ///< Index of the time subdivision used
         uint8_t freq_sub;    ///< Index of the frequency subdivision used
-        int16_t snr;
+        int16_t snr;         ///< SNR in 2500 Hz band, see ft8_snr() (not set by ft8_find_sync())
     } candidate_t;
 
     /// Structure that holds the decoded message
@@ -47,6 +47,7 @@ extern "C"
         // TODO: check again that this size is enough
         char text[33]; ///< Plain text
         uint16_t hash; ///< Hash value to be used in hash table and quick checking for duplicates
+        uint8_t payload[10]; ///< Source-encoded 77 bit payload, to re-encode the message
     } message_t;
 
     /// Structure that contains the status of various steps during decoding of a message
@@ -58,15 +59,32 @@ extern "C"
         int unpack_status;       ///< Return value of the unpack routine
     } decode_status_t;
 
+    /// Scratch memory of ft8_find_sync(): difference planes of the waterfall and pruning marks.
+    /// Sized for max_blocks of a waterfall, allocated once with it, so the search itself does not allocate.
+    typedef struct
+    {
+        int16_t* buf;     ///< Four difference planes and chunk sums
+        uint8_t* alive;   ///< Chunks worth scoring at sub-block time shifts
+        int buf_size;     ///< Number of buf entries
+        int alive_size;   ///< Number of alive entries
+    } sync_workspace_t;
+
+    /// Allocate sync search memory for a waterfall of power->max_blocks blocks
+    /// @return False if out of memory
+    bool ft8_sync_workspace_init(sync_workspace_t* ws, const waterfall_t* power);
+
+    /// Free memory of ft8_sync_workspace_init()
+    void ft8_sync_workspace_free(sync_workspace_t* ws);
+
     /// Localize top N candidates in frequency and time according to their sync strength (looking at Costas symbols)
     /// We treat and organize the candidate list as a min-heap (empty initially).
     /// @param[in] power Waterfall data collected during message slot
-    /// @param[in] sync_pattern Synchronization pattern
+    /// @param[in] ws Sync search memory, made by ft8_sync_workspace_init() for this waterfall
     /// @param[in] num_candidates Number of maximum candidates (size of heap array)
     /// @param[in,out] heap Array of candidate_t type entries (with num_candidates allocated entries)
     /// @param[in] min_score Minimal score allowed for pruning unlikely candidates (can be zero for no effect)
     /// @return Number of candidates filled in the heap
-    int ft8_find_sync(const waterfall_t* power, int num_candidates, candidate_t heap[], int min_score);
+    int ft8_find_sync(const waterfall_t* power, sync_workspace_t* ws, int num_candidates, candidate_t heap[], int min_score);
 
     /// Attempt to decode a message candidate. Extracts the bit probabilities, runs LDPC decoder, checks CRC and unpacks the message in plain text.
     /// @param[in] power Waterfall data collected during message slot
@@ -77,6 +95,32 @@ extern "C"
     /// @return True if the decoding was successful, false otherwise (check status for details)
     bool ft8_decode(const waterfall_t* power, const candidate_t* cand, message_t* message, int max_iterations, decode_status_t* status);
 
+    /// Decode a candidate with the ordered statistics decoder instead of LDPC, for candidates ft8_decode() failed on.
+    /// Much slower than ft8_decode(). Codewords too far from the channel hard decision are rejected before the CRC check
+    /// (see ldpc_osd_reliable()), still the false decode rate is above LDPC one, so use it on a few best candidates.
+    /// @param[in] power Waterfall data collected during message slot
+    /// @param[in] cand Candidate to decode
+    /// @param[out] message message_t structure that will receive the decoded message
+    /// @param[in] depth OSD order, 1 or 2 (number of flipped bits of the most reliable basis)
+    /// @param[out] status decode_status_t structure that will be filled with the status of various decoding steps
+    /// @return True if the decoding was successful, false otherwise (check status for details)
+    bool ft8_decode_osd(const waterfall_t* power, const candidate_t* cand, message_t* message, int depth, decode_status_t* status);
+
+    /// Estimate SNR of a candidate in 2500 Hz band, from its strongest and weakest magnitudes over the slot.
+    /// Not done by ft8_find_sync(), as only the candidates that decode need it.
+    /// @param[in] power Waterfall data collected during message slot
+    /// @param[in] cand Candidate to estimate
+    /// @return SNR in dB
+    int ft8_snr(const waterfall_t* power, const candidate_t* cand);
+
+    /// Remove a decoded message from the waterfall, so ft8_find_sync() on the residual finds weaker signals it masked.
+    /// Waterfall has no phase, so the message is re-encoded and magnitudes at its tones (and neighbour time and frequency
+    /// subdivisions) are clipped to the noise floor, the median of the band over the symbols of the message.
+    /// @param[in,out] power Waterfall data collected during message slot
+    /// @param[in] cand Candidate the message was decoded from
+    /// @param[in] message Decoded message
+    void ft8_subtract(waterfall_t* power, const candidate_t* cand, const message_t* message);
+
 #ifdef __cplusplus
 }
 #endif
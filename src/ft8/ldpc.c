@@ -18,9 +18,21 @@
 #include <stdbool.h>
 
 static int ldpc_check(uint8_t codeword[]);
+static float osd_discrepancy(const float rel[], const uint64_t diff[3], float limit);
 static float fast_tanh(float x);
 static float fast_atanh(float x);
 
+// Normalization of min-sum check messages, compensates overestimation of min() against BP
+static const float kLDPC_minsum_scale = 0.75f;
+
+// OSD-2 pairs are taken only among this many least reliable basis bits, as errors concentrate there
+static const int kLDPC_osd_pair_window = 48;
+
+// OSD result with a larger share of the total reliability disagreeing with the hard decision is rejected.
+// On pure noise LLRs OSD always finds some codeword and CRC-14 alone passes about 1 in 12k of them,
+// the limit keeps about 0.4% of those and about half of the decodes that only OSD recovers (ldpc_bench)
+static const float kLDPC_osd_max_discrepancy = 0.05f;
+
 // codeword is 174 log-likelihoods.
 // plain is a return value, 174 ints, to be 0 or 1.
 // max_iters is how hard to try.
@@ -212,6 +224,309 @@ void bp_decode(float codeword[], int max_iters, uint8_t plain[], int* ok)
     *ok = min_errors;
 }
 
+// Layered normalized min-sum decoder.
+// Messages are kept per edge of the sparse parity check matrix (check-major, 7 slots per check),
+// variable nodes hold only the running posterior, so the whole state is about 3 KB and lives in
+// a caller provided workspace. Checks are processed one by one and the posterior is updated
+// immediately, this converges in about half of the flooding schedule iterations.
+// Stops as soon as all parity checks are satisfied.
+void ldpc_minsum_decode(ldpc_workspace_t* ws, const float codeword[], int max_iters, uint8_t plain[], int* ok)
+{
+    float* post = ws->post;
+    int min_errors = FTX_LDPC_M;
+
+    // Internally LLR is log(P(x=0) / P(x=1)), the input has the opposite sign
+    for (int n = 0; n < FTX_LDPC_N; ++n)
+    {
+        post[n] = -codeword[n];
+    }
+
+    for (int e = 0; e < FTX_LDPC_M * 7; ++e)
+    {
+        ws->c2v[e] = 0.0f;
+    }
+
+    for (int iter = 0; iter <= max_iters; ++iter)
+    {
+        // Hard decision and early termination (before the first iteration as well)
+        int plain_sum = 0;
+        for (int n = 0; n < FTX_LDPC_N; ++n)
+        {
+            plain[n] = (post[n] < 0) ? 1 : 0;
+            plain_sum += plain[n];
+        }
+
+        if (plain_sum == 0)
+        {
+            // message converged to all-zeros, which is prohibited
+            break;
+        }
+
+        int errors = ldpc_check(plain);
+
+        if (errors < min_errors)
+        {
+            min_errors = errors;
+
+            if (errors == 0)
+            {
+                break;
+            }
+        }
+
+        if (iter == max_iters)
+        {
+            break;
+        }
+
+        for (int m = 0; m < FTX_LDPC_M; ++m)
+        {
+            const uint8_t* nm = kFTX_LDPC_Nm[m];
+            float* c2v = ws->c2v + m * 7;
+            int num = kFTX_LDPC_Num_rows[m];
+            float v2c[7];
+            float min1 = INFINITY, min2 = INFINITY;
+            int min_idx = 0;
+            uint32_t sign = 0;
+
+            // Variable to check messages: posterior without own contribution
+            for (int k = 0; k < num; ++k)
+            {
+                float t = post[nm[k] - 1] - c2v[k];
+                float a = fabsf(t);
+
+                v2c[k] = t;
+                sign ^= signbit(t) ? 1 : 0;
+
+                if (a < min1)
+                {
+                    min2 = min1;
+                    min1 = a;
+                    min_idx = k;
+                }
+                else if (a < min2)
+                {
+                    min2 = a;
+                }
+            }
+
+            min1 *= kLDPC_minsum_scale;
+            min2 *= kLDPC_minsum_scale;
+
+            // Check to variable messages and posterior update
+            for (int k = 0; k < num; ++k)
+            {
+                float mag = (k == min_idx) ? min2 : min1;
+                bool neg = sign ^ (signbit(v2c[k]) ? 1 : 0);
+                float msg = neg ? -mag : mag;
+
+                c2v[k] = msg;
+                post[nm[k] - 1] = v2c[k] + msg;
+            }
+        }
+    }
+
+    *ok = min_errors;
+}
+
+static float osd_discrepancy(const float rel[], const uint64_t diff[3], float limit)
+{
+    float sum = 0.0f;
+    for (int w = 0; w < 3; ++w)
+    {
+        uint64_t bits = diff[w];
+        while (bits)
+        {
+            sum += rel[w * 64 + __builtin_ctzll(bits)];
+            if (sum >= limit)
+            {
+                return sum;
+            }
+            bits &= bits - 1;
+        }
+    }
+    return sum;
+}
+
+// Ordered statistics decoding.
+// Codeword bits are ranked by reliability and the systematic generator [I | P] is brought by
+// Gaussian elimination to reduced form on the first K independent columns of that order.
+// Re-encoding the hard decision of those basis bits gives the order-0 codeword, test patterns
+// flip one or two basis bits, which is a XOR of one or two generator rows. Rows are bitsets in
+// reliability order, so each test costs a few word operations and a discrepancy sum that stops
+// as soon as it exceeds the best one.
+float ldpc_osd_decode(ldpc_osd_workspace_t* ws, const float codeword[], int depth, uint8_t plain[])
+{
+    uint8_t rank_of[FTX_LDPC_N];
+    uint8_t basis[FTX_LDPC_K];
+    uint64_t hard[3] = { 0 };
+
+    // Insertion sort by descending reliability, stable so equal |LLR| keep codeword order
+    for (int n = 0; n < FTX_LDPC_N; ++n)
+    {
+        float a = fabsf(codeword[n]);
+        int i = n;
+        while (i > 0 && ws->rel[i - 1] < a)
+        {
+            ws->rel[i] = ws->rel[i - 1];
+            ws->perm[i] = ws->perm[i - 1];
+            --i;
+        }
+        ws->rel[i] = a;
+        ws->perm[i] = n;
+    }
+
+    for (int c = 0; c < FTX_LDPC_N; ++c)
+    {
+        rank_of[ws->perm[c]] = c;
+        // Input is log(P(x=1) / P(x=0)), same as for ldpc_minsum_decode()
+        if (codeword[ws->perm[c]] > 0)
+        {
+            hard[c / 64] |= 1ull << (c % 64);
+        }
+    }
+
+    // Row k of the generator: message bit k and every parity bit that depends on it
+    for (int k = 0; k < FTX_LDPC_K; ++k)
+    {
+        uint64_t* row = ws->gen[k];
+        row[0] = row[1] = row[2] = 0;
+
+        int c = rank_of[k];
+        row[c / 64] |= 1ull << (c % 64);
+
+        for (int m = 0; m < FTX_LDPC_M; ++m)
+        {
+            if (kFTX_LDPC_generator[m][k / 8] & (0x80u >> (k % 8)))
+            {
+                c = rank_of[FTX_LDPC_K + m];
+                row[c / 64] |= 1ull << (c % 64);
+            }
+        }
+    }
+
+    // Reduce on the most reliable independent columns, the generator has full rank K
+    int rank = 0;
+    for (int c = 0; c < FTX_LDPC_N && rank < FTX_LDPC_K; ++c)
+    {
+        uint64_t mask = 1ull << (c % 64);
+        int w = c / 64;
+        int pivot = rank;
+
+        while (pivot < FTX_LDPC_K && !(ws->gen[pivot][w] & mask))
+        {
+            ++pivot;
+        }
+        if (pivot == FTX_LDPC_K)
+        {
+            continue;
+        }
+
+        if (pivot != rank)
+        {
+            for (int i = 0; i < 3; ++i)
+            {
+                uint64_t t = ws->gen[pivot][i];
+                ws->gen[pivot][i] = ws->gen[rank][i];
+                ws->gen[rank][i] = t;
+            }
+        }
+
+        for (int k = 0; k < FTX_LDPC_K; ++k)
+        {
+            if (k != rank && (ws->gen[k][w] & mask))
+            {
+                ws->gen[k][0] ^= ws->gen[rank][0];
+                ws->gen[k][1] ^= ws->gen[rank][1];
+                ws->gen[k][2] ^= ws->gen[rank][2];
+            }
+        }
+
+        basis[rank++] = c;
+    }
+
+    // Order-0: re-encode hard decision of the basis, keep the difference against the hard decision
+    uint64_t diff0[3] = { hard[0], hard[1], hard[2] };
+    for (int k = 0; k < rank; ++k)
+    {
+        if (hard[basis[k] / 64] & (1ull << (basis[k] % 64)))
+        {
+            diff0[0] ^= ws->gen[k][0];
+            diff0[1] ^= ws->gen[k][1];
+            diff0[2] ^= ws->gen[k][2];
+        }
+    }
+
+    float best = osd_discrepancy(ws->rel, diff0, INFINITY);
+    int best_a = -1, best_b = -1;
+
+    if (depth >= 1)
+    {
+        for (int a = 0; a < rank; ++a)
+        {
+            uint64_t d[3] = { diff0[0] ^ ws->gen[a][0], diff0[1] ^ ws->gen[a][1], diff0[2] ^ ws->gen[a][2] };
+            float dist = osd_discrepancy(ws->rel, d, best);
+            if (dist < best)
+            {
+                best = dist;
+                best_a = a;
+                best_b = -1;
+            }
+        }
+    }
+
+    if (depth >= 2)
+    {
+        int first = rank > kLDPC_osd_pair_window ? rank - kLDPC_osd_pair_window : 0;
+        for (int a = first; a < rank; ++a)
+        {
+            uint64_t da[3] = { diff0[0] ^ ws->gen[a][0], diff0[1] ^ ws->gen[a][1], diff0[2] ^ ws->gen[a][2] };
+            for (int b = a + 1; b < rank; ++b)
+            {
+                uint64_t d[3] = { da[0] ^ ws->gen[b][0], da[1] ^ ws->gen[b][1], da[2] ^ ws->gen[b][2] };
+                float dist = osd_discrepancy(ws->rel, d, best);
+                if (dist < best)
+                {
+                    best = dist;
+                    best_a = a;
+                    best_b = b;
+                }
+            }
+        }
+    }
+
+    // Codeword in reliability order is the hard decision with the discrepant bits flipped
+    uint64_t cw[3] = { hard[0] ^ diff0[0], hard[1] ^ diff0[1], hard[2] ^ diff0[2] };
+    for (int i = 0; i < 3; ++i)
+    {
+        if (best_a >= 0)
+        {
+            cw[i] ^= ws->gen[best_a][i];
+        }
+        if (best_b >= 0)
+        {
+            cw[i] ^= ws->gen[best_b][i];
+        }
+    }
+
+    for (int c = 0; c < FTX_LDPC_N; ++c)
+    {
+        plain[ws->perm[c]] = (cw[c / 64] >> (c % 64)) & 1;
+    }
+
+    return best;
+}
+
+bool ldpc_osd_reliable(const float codeword[], float discrepancy)
+{
+    float total = 0.0f;
+    for (int n = 0; n < FTX_LDPC_N; ++n)
+    {
+        total += fabsf(codeword[n]);
+    }
+    return discrepancy <= kLDPC_osd_max_discrepancy * total;
+}
+
 // Ideas for approximating tanh/atanh:
 // * https://varietyofsound.wordpress.com/2011/02/14/efficient-tanh-computation-using-lamberts-continued-fraction/
 // * http://functions.wolfram.com/ElementaryFunctions/ArcTanh/10/0001/
@@ -2,6 +2,9 @@
 #define _INCLUDE_LDPC_H_
 
 #include <stdint.h>
+#include <stdbool.h>
+
+#include "constants.h"
 
 #ifdef __cplusplus
 extern "C"
@@ -16,6 +19,37 @@ extern "C"
 
     void bp_decode(float codeword[], int max_iters, uint8_t plain[], int* ok);
 
+    /// State of ldpc_minsum_decode(), can be reused between calls (one per thread)
+    typedef struct
+    {
+        float c2v[FTX_LDPC_M * 7]; ///< Check to variable messages, 7 slots per check (row of Nm)
+        float post[FTX_LDPC_N];    ///< Posterior log-likelihoods
+    } ldpc_workspace_t;
+
+    /// Sparse layered min-sum decoder without stack matrices or allocations.
+    /// Same conventions as bp_decode(): ok is the number of unsatisfied parity checks, 0 means success.
+    void ldpc_minsum_decode(ldpc_workspace_t* ws, const float codeword[], int max_iters, uint8_t plain[], int* ok);
+
+    /// State of ldpc_osd_decode(), can be reused between calls (one per thread)
+    typedef struct
+    {
+        uint64_t gen[FTX_LDPC_K][3]; ///< Systematic generator, reduced on the most reliable basis (columns in reliability order)
+        uint8_t perm[FTX_LDPC_N];    ///< Codeword bit index by reliability rank
+        float rel[FTX_LDPC_N];       ///< Reliability |LLR| by rank
+    } ldpc_osd_workspace_t;
+
+    /// Ordered statistics decoder, fallback for codewords the iterative decoder could not correct.
+    /// Re-encodes the hard decision on the K most reliable independent bits, with all single (depth 1)
+    /// or also pairs (depth 2) of flips among them, and returns the codeword closest to the channel
+    /// log-likelihoods. The result always satisfies parity checks, so the CRC must be verified by the caller.
+    /// @return Correlation discrepancy of the chosen codeword (sum of |LLR| of bits disagreeing with the hard decision)
+    float ldpc_osd_decode(ldpc_osd_workspace_t* ws, const float codeword[], int depth, uint8_t plain[]);
+
+    /// False decode guard for ldpc_osd_decode(): OSD finds a codeword even in pure noise, so the result is
+    /// accepted only if its discrepancy is a small share of the total reliability of the log-likelihoods.
+    /// @return true if the codeword may be passed to the CRC check
+    bool ldpc_osd_reliable(const float codeword[], float discrepancy);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,149 @@
+/*
+ *  SPDX-License-Identifier: LGPL-2.1-or-later
+ *
+ *  Xiegu X6100 LVGL GUI
+ *
+ *  Copyright (c) 2022-2023 Belousov Oleg aka R1CBU
+ */
+
+#include "ft8_pool.h"
+
+#include "lvgl/lvgl.h"
+#include "util.h"
+
+#include <pthread.h>
+#include <unistd.h>
+
+#define MAX_WORKERS 3
+
+static pthread_mutex_t      mux = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t       work_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t       done_cond = PTHREAD_COND_INITIALIZER;
+
+static uint8_t              workers = 0;
+
+/* Current batch, guarded by mux */
+
+static uint32_t             generation = 0;
+static const waterfall_t    *batch_wf;
+static ft8_job_t            *batch_jobs;
+static uint16_t             batch_count = 0;
+static uint16_t             batch_next = 0;
+static uint16_t             batch_done = 0;
+static int                  batch_iterations;
+static uint64_t             batch_deadline;
+
+/**
+ * Take and decode jobs of the current batch until none left. mux must be locked
+ */
+static void run_jobs() {
+    while (batch_next < batch_count) {
+        ft8_job_t           *job = &batch_jobs[batch_next++];
+        const waterfall_t   *wf = batch_wf;
+        int                 iterations = batch_iterations;
+        uint64_t            deadline = batch_deadline;
+
+        pthread_mutex_unlock(&mux);
+
+        if (deadline && get_time() >= deadline) {
+            job->ok = false;
+        } else if (job->osd_depth) {
+            job->ok = ft8_decode_osd(wf, &job->cand, &job->message, job->osd_depth, &job->status);
+        } else {
+            job->ok = ft8_decode(wf, &job->cand, &job->message, iterations, &job->status);
+        }
+
+        if (job->ok) {
+            job->cand.snr = ft8_snr(wf, &job->cand);
+        }
+
+        pthread_mutex_lock(&mux);
+
+        batch_done++;
+
+        if (batch_done == batch_count) {
+            pthread_cond_signal(&done_cond);
+        }
+    }
+}
+
+static void * worker_thread(void *arg) {
+    uint32_t seen = 0;
+
+    pthread_mutex_lock(&mux);
+
+    while (true) {
+        while (seen == generation) {
+            pthread_cond_wait(&work_cond, &mux);
+        }
+
+        seen = generation;
+        run_jobs();
+    }
+
+    return NULL;
+}
+
+/**
+ * Start workers, one less than CPU cores: caller of ft8_pool_decode() works too
+ */
+void ft8_pool_init() {
+    if (workers) {
+        return;
+    }
+
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    long n = cpus > 1 ? cpus - 1 : 0;
+
+    if (n > MAX_WORKERS) {
+        n = MAX_WORKERS;
+    }
+
+    for (long i = 0; i < n; i++) {
+        pthread_t thread;
+
+        if (pthread_create(&thread, NULL, worker_thread, NULL) != 0) {
+            LV_LOG_ERROR("Can't create FT8 worker");
+            break;
+        }
+
+        pthread_detach(thread);
+        workers++;
+    }
+}
+
+/**
+ * Decode all jobs and return when they are done. Results are in jobs, in the same order.
+ * Jobs not started before deadline (get_time() ms, 0 - none) are skipped as failed
+ */
+void ft8_pool_decode(const waterfall_t *wf, ft8_job_t *jobs, uint16_t count, int max_iterations, uint64_t deadline) {
+    int cancel_state;
+
+    /* Workers use the batch, so the caller must not be cancelled in the middle */
+
+    pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &cancel_state);
+    pthread_mutex_lock(&mux);
+
+    batch_wf = wf;
+    batch_jobs = jobs;
+    batch_count = count;
+    batch_next = 0;
+    batch_done = 0;
+    batch_iterations = max_iterations;
+    batch_deadline = deadline;
+    generation++;
+
+    pthread_cond_broadcast(&work_cond);
+    run_jobs();
+
+    while (batch_done < batch_count) {
+        pthread_cond_wait(&done_cond, &mux);
+    }
+
+    pthread_mutex_unlock(&mux);
+    pthread_setcancelstate(cancel_state, NULL);
+}
+
+uint8_t ft8_pool_threads() {
+    return workers + 1;
+}
@@ -0,0 +1,29 @@
+/*
+ *  SPDX-License-Identifier: LGPL-2.1-or-later
+ *
+ *  Xiegu X6100 LVGL GUI
+ *
+ *  Copyright (c) 2022-2023 Belousov Oleg aka R1CBU
+ */
+
+#pragma once
+
+#include "ft8/decode.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Worker pool for FT8/FT4 candidates decoding against read-only waterfall */
+
+typedef struct {
+    candidate_t     cand;
+    uint8_t         osd_depth;  /* 0 - LDPC decoding, 1..2 - OSD fallback of this order */
+
+    bool            ok;
+    message_t       message;
+    decode_status_t status;
+} ft8_job_t;
+
+void ft8_pool_init();
+void ft8_pool_decode(const waterfall_t *wf, ft8_job_t *jobs, uint16_t count, int max_iterations, uint64_t deadline);
+uint8_t ft8_pool_threads();
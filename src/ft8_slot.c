@@ -0,0 +1,376 @@
+/*
+ *  SPDX-License-Identifier: LGPL-2.1-or-later
+ *
+ *  Xiegu X6100 LVGL GUI
+ *
+ *  Copyright (c) 2022-2023 Belousov Oleg aka R1CBU
+ */
+
+#include "ft8_slot.h"
+
+#include "util.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define MIN_SCORE       10
+#define MAX_CANDIDATES  120
+#define LDPC_ITER       20
+#define MAX_DECODED     50
+
+#define OSD_CANDIDATES  32      /* Failed candidates given to OSD fallback per slot */
+#define OSD_MAX_ERRORS  24      /* Parity checks left by LDPC, above it OSD is hopeless (saves time, noise passes it too) */
+#define OSD_BUDGET_MS   400     /* Per slot, on top of LDPC decoding, not cut by the slot deadline */
+
+#define EARLY_CANDIDATES    40  /* Strongest candidates tried on a partial waterfall */
+#define EARLY_MIN_SCORE     20
+#define EARLY_STEP_MS       500 /* Period of early decoding while the slot goes on */
+
+struct ft8_slot_s {
+    ft8_wf_t        ft8_wf;
+    waterfall_t     *wf;
+    ft8_slot_cb_t   cb;
+    void            *user;
+
+    uint16_t        data_blocks;    /* Blocks from the message start to the end of its data symbols */
+    uint16_t        early_step;
+    uint16_t        early_block;    /* Next early decoding when the waterfall has that many blocks */
+    ft8_job_t       early_jobs[MAX_DECODED];
+    uint16_t        num_early;
+
+    candidate_t     candidate_list[MAX_CANDIDATES];
+    ft8_job_t       jobs[MAX_CANDIDATES];
+    ft8_job_t       osd_jobs[OSD_CANDIDATES];
+    message_t       decoded[MAX_DECODED];
+    message_t       *decoded_hashtable[MAX_DECODED];
+
+#ifdef FT8_PROFILE
+    uint64_t        stage_ns[FT8_SLOT_STAGE_LAST];
+#endif
+};
+
+static const char *stage_names[FT8_SLOT_STAGE_LAST] = {
+    "sync", "decode", "subtract", "osd"
+};
+
+#ifdef FT8_PROFILE
+
+static uint64_t stage_start() {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint64_t) now.tv_sec * 1000000000L + now.tv_nsec;
+}
+
+#define stage_end(s, stage, start) (s)->stage_ns[stage] += stage_start() - (start)
+
+#else
+
+#define stage_start()               0
+#define stage_end(s, stage, start)  (void) (start)
+
+#endif
+
+ft8_slot_t ft8_slot_create(ft8_wf_t wf, ft8_slot_cb_t cb, void *user) {
+    ft8_slot_t s = calloc(1, sizeof(struct ft8_slot_s));
+
+    if (!s) {
+        return NULL;
+    }
+
+    s->ft8_wf = wf;
+    s->wf = ft8_wf_waterfall(wf);
+    s->cb = cb;
+    s->user = user;
+
+    float symbol_period;
+
+    switch (s->wf->protocol) {
+        case PROTO_FT4:
+            symbol_period = FT4_SYMBOL_PERIOD;
+            s->data_blocks = FT4_NN - FT4_LENGTH_SYNC - FT4_NR / 2;
+            break;
+
+        default:
+            symbol_period = FT8_SYMBOL_PERIOD;
+            s->data_blocks = FT8_NN - FT8_LENGTH_SYNC;
+            break;
+    }
+
+    s->early_step = EARLY_STEP_MS / (symbol_period * 1000.0f);
+
+    if (s->early_step == 0) {
+        s->early_step = 1;
+    }
+
+    ft8_slot_reset(s);
+
+    return s;
+}
+
+void ft8_slot_destroy(ft8_slot_t s) {
+    free(s);
+}
+
+/**
+ * New slot: the waterfall, decoded messages and early decoding start over
+ */
+void ft8_slot_reset(ft8_slot_t s) {
+    ft8_wf_reset(s->ft8_wf);
+
+    s->early_block = s->data_blocks;
+    s->num_early = 0;
+
+    memset(s->decoded_hashtable, 0, sizeof(s->decoded_hashtable));
+    memset(s->decoded, 0, sizeof(s->decoded));
+}
+
+/**
+ * Returns false for duplicate or when the table is full
+ */
+static bool add_decoded(ft8_slot_t s, const message_t *message) {
+    uint16_t idx_hash = message->hash % MAX_DECODED;
+
+    for (uint16_t i = 0; i < MAX_DECODED; i++) {
+        if (s->decoded_hashtable[idx_hash] == NULL) {
+            memcpy(&s->decoded[idx_hash], message, sizeof(*message));
+            s->decoded_hashtable[idx_hash] = &s->decoded[idx_hash];
+
+            return true;
+        }
+
+        if (s->decoded_hashtable[idx_hash]->hash == message->hash && strcmp(s->decoded_hashtable[idx_hash]->text, message->text) == 0) {
+            return false;
+        }
+
+        idx_hash = (idx_hash + 1) % MAX_DECODED;
+    }
+
+    return false;
+}
+
+/**
+ * Ranking of failed candidates for OSD: fewer parity errors left by LDPC first, then higher sync score
+ */
+static bool osd_better(const ft8_job_t *a, const ft8_job_t *b) {
+    if (a->status.ldpc_errors != b->status.ldpc_errors) {
+        return a->status.ldpc_errors < b->status.ldpc_errors;
+    }
+
+    return a->cand.score > b->cand.score;
+}
+
+/**
+ * Second chance for near-threshold candidates: the best of them are decoded by OSD within time budget
+ */
+static void decode_osd(ft8_slot_t s, uint16_t num_jobs, uint8_t osd_depth, uint64_t deadline) {
+    uint16_t    num_osd = 0;
+    uint64_t    start = stage_start();
+
+    for (uint16_t idx = 0; idx < num_jobs; idx++) {
+        const ft8_job_t *job = &s->jobs[idx];
+
+        /* Converged with wrong CRC is a wrong codeword already, OSD would find the same */
+
+        if (job->ok || job->status.ldpc_errors == 0 || job->status.ldpc_errors > OSD_MAX_ERRORS) {
+            continue;
+        }
+
+        uint16_t pos = num_osd < OSD_CANDIDATES ? num_osd++ : OSD_CANDIDATES;
+
+        while (pos > 0 && osd_better(job, &s->osd_jobs[pos - 1])) {
+            if (pos < OSD_CANDIDATES) {
+                s->osd_jobs[pos] = s->osd_jobs[pos - 1];
+            }
+            pos--;
+        }
+
+        if (pos < OSD_CANDIDATES) {
+            s->osd_jobs[pos] = *job;
+            s->osd_jobs[pos].osd_depth = osd_depth;
+        }
+    }
+
+    if (num_osd > 0) {
+        ft8_pool_decode(s->wf, s->osd_jobs, num_osd, LDPC_ITER, deadline);
+
+        for (uint16_t idx = 0; idx < num_osd; idx++) {
+            ft8_job_t *job = &s->osd_jobs[idx];
+
+            if (job->ok && add_decoded(s, &job->message)) {
+                s->cb(job, s->user);
+            }
+        }
+    }
+
+    stage_end(s, FT8_SLOT_STAGE_OSD, start);
+}
+
+/**
+ * One pass over the waterfall. Decoded signals are subtracted from it for the next pass
+ */
+static uint16_t decode_pass(ft8_slot_t s, bool subtract, uint16_t *num_decoded) {
+    uint64_t    start = stage_start();
+    uint16_t    num_candidates = ft8_find_sync(s->wf, ft8_wf_sync_workspace(s->ft8_wf), MAX_CANDIDATES, s->candidate_list, MIN_SCORE);
+    uint16_t    num_jobs = 0;
+
+    stage_end(s, FT8_SLOT_STAGE_SYNC, start);
+
+    for (uint16_t idx = 0; idx < num_candidates; idx++) {
+        const candidate_t *cand = &s->candidate_list[idx];
+
+        if (cand->score < MIN_SCORE)
+            continue;
+
+        s->jobs[num_jobs].cand = *cand;
+        s->jobs[num_jobs].osd_depth = 0;
+        num_jobs++;
+    }
+
+    /* Candidates are decoded in parallel, results are merged in score order */
+
+    start = stage_start();
+    ft8_pool_decode(s->wf, s->jobs, num_jobs, LDPC_ITER, 0);
+    stage_end(s, FT8_SLOT_STAGE_DECODE, start);
+
+    *num_decoded = 0;
+    start = stage_start();
+
+    for (uint16_t idx = 0; idx < num_jobs; idx++) {
+        ft8_job_t *job = &s->jobs[idx];
+
+        if (job->ok && add_decoded(s, &job->message)) {
+            s->cb(job, s->user);
+
+            if (subtract) {
+                ft8_subtract(s->wf, &job->cand, &job->message);
+            }
+            (*num_decoded)++;
+        }
+    }
+
+    stage_end(s, FT8_SLOT_STAGE_SUBTRACT, start);
+
+    return num_jobs;
+}
+
+/**
+ * Candidate is at a message decoded early in this slot
+ */
+static bool early_decoded(ft8_slot_t s, const candidate_t *cand) {
+    for (uint16_t idx = 0; idx < s->num_early; idx++) {
+        const candidate_t *early = &s->early_jobs[idx].cand;
+
+        if (abs(cand->time_offset - early->time_offset) <= 1 && abs(cand->freq_offset - early->freq_offset) <= 1) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * Decoding of strong candidates on a partial waterfall, when all of their data symbols are in.
+ * Waterfall is left intact, decoded messages are subtracted from the full one at the slot end
+ */
+static void decode_early(ft8_slot_t s) {
+    uint16_t    num_candidates = ft8_find_sync(s->wf, ft8_wf_sync_workspace(s->ft8_wf), EARLY_CANDIDATES, s->candidate_list, EARLY_MIN_SCORE);
+    uint16_t    num_jobs = 0;
+
+    for (uint16_t idx = 0; idx < num_candidates; idx++) {
+        const candidate_t *cand = &s->candidate_list[idx];
+
+        if (cand->score < EARLY_MIN_SCORE || cand->time_offset + s->data_blocks > s->wf->num_blocks || early_decoded(s, cand))
+            continue;
+
+        s->jobs[num_jobs].cand = *cand;
+        s->jobs[num_jobs].osd_depth = 0;
+        num_jobs++;
+    }
+
+    ft8_pool_decode(s->wf, s->jobs, num_jobs, LDPC_ITER, 0);
+
+    for (uint16_t idx = 0; idx < num_jobs; idx++) {
+        ft8_job_t *job = &s->jobs[idx];
+
+        if (job->ok && add_decoded(s, &job->message)) {
+            s->cb(job, s->user);
+
+            if (s->num_early < MAX_DECODED) {
+                s->early_jobs[s->num_early++] = *job;
+            }
+        }
+    }
+}
+
+/**
+ * Call after each waterfall block. Decodes early every EARLY_STEP_MS of the slot,
+ * except right before the full decoding where it is not worth it
+ */
+void ft8_slot_early(ft8_slot_t s) {
+    if (s->wf->num_blocks < s->early_block) {
+        return;
+    }
+
+    if (s->wf->num_blocks + s->early_step <= s->wf->max_blocks) {
+        decode_early(s);
+    }
+
+    s->early_block = s->wf->num_blocks + s->early_step;
+}
+
+/**
+ * Decode the slot. Passes with subtraction go on while they find new messages
+ * and the last pass duration fits into the time left till deadline (get_time() ms,
+ * 0 - none), with the OSD budget kept after it. Messages decoded early are subtracted
+ * first, passes look for the rest. OSD of osd_depth (0 - off) works on candidates
+ * failed in the last pass, within its own budget even when the passes ran late.
+ * Returns count of passes done
+ */
+uint8_t ft8_slot_decode(ft8_slot_t s, uint64_t deadline, uint8_t passes, uint8_t osd_depth) {
+    uint16_t    num_jobs = 0;
+    uint8_t     done = 0;
+    uint64_t    reserve = osd_depth ? OSD_BUDGET_MS : 0;
+
+    for (uint16_t idx = 0; idx < s->num_early; idx++) {
+        ft8_subtract(s->wf, &s->early_jobs[idx].cand, &s->early_jobs[idx].message);
+    }
+
+    for (uint8_t pass = 0; pass < passes; pass++) {
+        uint64_t    start = get_time();
+        uint16_t    num_decoded;
+        bool        last = pass + 1 == passes;
+
+        num_jobs = decode_pass(s, !last, &num_decoded);
+        done++;
+
+        uint64_t    now = get_time();
+
+        if (num_decoded == 0 || (deadline && now + (now - start) + reserve > deadline)) {
+            break;
+        }
+    }
+
+    if (osd_depth) {
+        decode_osd(s, num_jobs, osd_depth, get_time() + OSD_BUDGET_MS);
+    }
+
+    return done;
+}
+
+const char * ft8_slot_stage_name(ft8_slot_stage_t stage) {
+    return stage_names[stage];
+}
+
+/**
+ * Accumulated ns of the stages, FT8_SLOT_STAGE_LAST of them
+ */
+void ft8_slot_stats_get(ft8_slot_t s, uint64_t *ns) {
+#ifdef FT8_PROFILE
+    memcpy(ns, s->stage_ns, sizeof(s->stage_ns));
+#else
+    memset(ns, 0, FT8_SLOT_STAGE_LAST * sizeof(uint64_t));
+#endif
+}
@@ -0,0 +1,54 @@
+/*
+ *  SPDX-License-Identifier: LGPL-2.1-or-later
+ *
+ *  Xiegu X6100 LVGL GUI
+ *
+ *  Copyright (c) 2022-2023 Belousov Oleg aka R1CBU
+ */
+
+#pragma once
+
+#include "ft8_wf.h"
+#include "ft8_pool.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Decoding of one FT8/FT4 slot on the ft8_wf waterfall: early decoding of
+ * strong signals while the slot goes on, passes of sync search, LDPC decoding
+ * and subtraction at the slot end, then OSD fallback of the failed candidates.
+ * New messages go to the callback, duplicates within the slot are dropped.
+ * Used by the FT8 dialog and ft8_bench.
+ */
+
+#define FT8_SLOT_TIME_OSR   4   /* Waterfall oversampling the decoding is tuned for */
+#define FT8_SLOT_FREQ_OSR   2
+
+#define FT8_SLOT_PASSES     3   /* Decoding passes with subtraction of decoded signals */
+#define FT8_SLOT_OSD_DEPTH  2
+
+/* Per-stage timing, collected only when built with FT8_PROFILE */
+
+typedef enum {
+    FT8_SLOT_STAGE_SYNC = 0,
+    FT8_SLOT_STAGE_DECODE,
+    FT8_SLOT_STAGE_SUBTRACT,
+    FT8_SLOT_STAGE_OSD,
+
+    FT8_SLOT_STAGE_LAST
+} ft8_slot_stage_t;
+
+typedef struct ft8_slot_s * ft8_slot_t;
+
+typedef void (*ft8_slot_cb_t)(const ft8_job_t *job, void *user);
+
+ft8_slot_t ft8_slot_create(ft8_wf_t wf, ft8_slot_cb_t cb, void *user);
+void ft8_slot_destroy(ft8_slot_t s);
+
+void ft8_slot_reset(ft8_slot_t s);
+void ft8_slot_early(ft8_slot_t s);
+uint8_t ft8_slot_decode(ft8_slot_t s, uint64_t deadline, uint8_t passes, uint8_t osd_depth);
+
+const char * ft8_slot_stage_name(ft8_slot_stage_t stage);
+void ft8_slot_stats_get(ft8_slot_t s, uint64_t *ns);
@@ -0,0 +1,302 @@
+/*
+ *  SPDX-License-Identifier: LGPL-2.1-or-later
+ *
+ *  Xiegu X6100 LVGL GUI
+ *
+ *  Copyright (c) 2022-2023 Belousov Oleg aka R1CBU
+ */
+
+#include "ft8_wf.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <liquid/liquid.h>
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+/* dB quantizer cells: exponent and top mantissa bits of the power, 0.19 dB wide (less than 0.5 dB step) */
+
+#define DB_CELL_SHIFT   19
+
+struct ft8_wf_s {
+    waterfall_t     wf;
+    sync_workspace_t sync_ws;
+
+    uint32_t        block_size;
+    uint32_t        subblock_size;
+    uint32_t        nfft;
+    float           scaled_offset;
+    bool            reference;
+
+    float           *power;
+    float           db_min;         /* Lowest power quantized to 1 */
+    float           db_max;         /* Lowest power quantized to 255 */
+    uint32_t        db_cell_min;
+    uint8_t         *db_cell_lo;    /* Value at the cell start */
+    float           *db_cell_step;  /* Power in the cell where value becomes lo + 1, or infinity */
+
+    windowcf        frame_window;
+    complex float   *rx_window;
+    complex float   *time_buf;
+    complex float   *freq_buf;
+    fftplan         fft;
+};
+
+/**
+ * Reference quantizer of power to 0.5 dB units
+ */
+static uint8_t quantize_db(float v, float scaled_offset) {
+    float   db = 10.0f * log10f(v);
+    int     scaled = (int16_t) (db * 2.0f + scaled_offset);
+
+    if (scaled < 0) {
+        scaled = 0;
+    } else if (scaled > 255) {
+        scaled = 255;
+    }
+
+    return scaled;
+}
+
+static uint32_t float_bits(float v) {
+    uint32_t bits;
+
+    memcpy(&bits, &v, sizeof(bits));
+
+    return bits;
+}
+
+static float bits_float(uint32_t bits) {
+    float v;
+
+    memcpy(&v, &bits, sizeof(v));
+
+    return v;
+}
+
+/**
+ * Lowest positive power quantized to value or above. Binary search over bits,
+ * as positive floats are ordered the same as their bits
+ */
+static float db_step(float scaled_offset, uint8_t value) {
+    uint32_t lo = 0;
+    uint32_t hi = float_bits(INFINITY);
+
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+
+        if (quantize_db(bits_float(mid), scaled_offset) >= value) {
+            hi = mid;
+        } else {
+            lo = mid + 1;
+        }
+    }
+
+    return bits_float(lo);
+}
+
+/**
+ * Table of the fast quantizer, made with the reference one, so the results are the same
+ */
+static void db_table_create(ft8_wf_t w) {
+    float steps[256];
+
+    for (int i = 1; i < 256; i++) {
+        steps[i] = db_step(w->scaled_offset, i);
+    }
+
+    w->db_min = steps[1];
+    w->db_max = steps[255];
+    w->db_cell_min = float_bits(w->db_min) >> DB_CELL_SHIFT;
+
+    uint32_t num_cells = (float_bits(w->db_max) >> DB_CELL_SHIFT) - w->db_cell_min + 1;
+
+    w->db_cell_lo = malloc(num_cells * sizeof(uint8_t));
+    w->db_cell_step = malloc(num_cells * sizeof(float));
+
+    for (uint32_t i = 0; i < num_cells; i++) {
+        float   start = bits_float((w->db_cell_min + i) << DB_CELL_SHIFT);
+        float   end = bits_float((w->db_cell_min + i + 1) << DB_CELL_SHIFT);
+        uint8_t lo = quantize_db(start, w->scaled_offset);
+
+        w->db_cell_lo[i] = lo;
+        w->db_cell_step[i] = (lo < 255 && steps[lo + 1] < end) ? steps[lo + 1] : INFINITY;
+    }
+}
+
+static void power(float *dst, const complex float *src, size_t n) {
+    size_t i = 0;
+
+#if defined(__ARM_NEON)
+    for (; i + 4 <= n; i += 4) {
+        float32x4x2_t x = vld2q_f32((const float *) &src[i]);
+
+        vst1q_f32(dst + i, vmlaq_f32(vmulq_f32(x.val[0], x.val[0]), x.val[1], x.val[1]));
+    }
+#endif
+
+    for (; i < n; i++) {
+        dst[i] = crealf(src[i]) * crealf(src[i]) + cimagf(src[i]) * cimagf(src[i]);
+    }
+}
+
+ft8_wf_t ft8_wf_create(ftx_protocol_t protocol, uint32_t sample_rate, uint8_t time_osr, uint8_t freq_osr) {
+    float slot_time, symbol_period;
+
+    switch (protocol) {
+        case PROTO_FT4:
+            slot_time = FT4_SLOT_TIME;
+            symbol_period = FT4_SYMBOL_PERIOD;
+            break;
+
+        default:
+            slot_time = FT8_SLOT_TIME;
+            symbol_period = FT8_SYMBOL_PERIOD;
+            break;
+    }
+
+    ft8_wf_t w = calloc(1, sizeof(struct ft8_wf_s));
+
+    w->block_size = sample_rate * symbol_period;
+    w->subblock_size = w->block_size / time_osr;
+    w->nfft = w->block_size * freq_osr;
+    w->scaled_offset = 300.0f + 40.0f * log10f(2.0f / w->nfft);
+
+    const uint32_t max_blocks = slot_time / symbol_period;
+    const uint32_t num_bins = sample_rate * symbol_period / 2;
+
+    w->wf.max_blocks = max_blocks;
+    w->wf.num_bins = num_bins;
+    w->wf.time_osr = time_osr;
+    w->wf.freq_osr = freq_osr;
+    w->wf.block_stride = time_osr * freq_osr * num_bins;
+    w->wf.mag = (uint8_t *) malloc(max_blocks * w->wf.block_stride * sizeof(uint8_t));
+    w->wf.protocol = protocol;
+
+    /* On failure sizes are 0 and ft8_find_sync() finds nothing */
+    ft8_sync_workspace_init(&w->sync_ws, &w->wf);
+
+    w->time_buf = (complex float *) malloc(w->nfft * sizeof(complex float));
+    w->freq_buf = (complex float *) malloc(w->nfft * sizeof(complex float));
+    w->fft = fft_create_plan(w->nfft, w->time_buf, w->freq_buf, LIQUID_FFT_FORWARD, 0);
+    w->frame_window = windowcf_create(w->nfft);
+
+    w->rx_window = malloc(w->nfft * sizeof(complex float));
+    w->power = malloc(num_bins * freq_osr * sizeof(float));
+
+    db_table_create(w);
+
+    for (uint32_t i = 0; i < w->nfft; i++)
+        w->rx_window[i] = liquid_hann(i, w->nfft);
+
+    float gain = 0.0f;
+
+    for (uint32_t i = 0; i < w->nfft; i++)
+        gain += w->rx_window[i] * w->rx_window[i];
+
+    gain = 1.0f / sqrtf(gain);
+
+    for (uint32_t i = 0; i < w->nfft; i++)
+        w->rx_window[i] *= gain;
+
+    return w;
+}
+
+void ft8_wf_destroy(ft8_wf_t w) {
+    free(w->wf.mag);
+    ft8_sync_workspace_free(&w->sync_ws);
+    windowcf_destroy(w->frame_window);
+    free(w->time_buf);
+    free(w->freq_buf);
+    fft_destroy_plan(w->fft);
+    free(w->rx_window);
+    free(w->power);
+    free(w->db_cell_lo);
+    free(w->db_cell_step);
+    free(w);
+}
+
+waterfall_t * ft8_wf_waterfall(ft8_wf_t w) {
+    return &w->wf;
+}
+
+sync_workspace_t * ft8_wf_sync_workspace(ft8_wf_t w) {
+    return &w->sync_ws;
+}
+
+uint32_t ft8_wf_block_size(ft8_wf_t w) {
+    return w->block_size;
+}
+
+/**
+ * Add block_size samples to the waterfall. Returns false when it is full already
+ */
+bool ft8_wf_process(ft8_wf_t w, float complex *frame) {
+    waterfall_t     *wf = &w->wf;
+
+    if (wf->num_blocks >= wf->max_blocks) {
+        return false;
+    }
+
+    complex float   *frame_ptr;
+    int             offset = wf->num_blocks * wf->block_stride;
+    int             frame_pos = 0;
+
+    for (int time_sub = 0; time_sub < wf->time_osr; time_sub++) {
+        windowcf_write(w->frame_window, &frame[frame_pos], w->subblock_size);
+        frame_pos += w->subblock_size;
+
+        windowcf_read(w->frame_window, &frame_ptr);
+
+        liquid_vectorcf_mul(w->rx_window, frame_ptr, w->nfft, w->time_buf);
+
+        fft_execute(w->fft);
+
+        power(w->power, w->freq_buf, wf->num_bins * wf->freq_osr);
+
+        for (int freq_sub = 0; freq_sub < wf->freq_osr; freq_sub++) {
+            const float *src = w->power + freq_sub;
+            uint8_t     *dst = wf->mag + offset;
+
+            if (w->reference) {
+                for (int bin = 0; bin < wf->num_bins; bin++) {
+                    dst[bin] = quantize_db(src[bin * wf->freq_osr], w->scaled_offset);
+                }
+            } else {
+                for (int bin = 0; bin < wf->num_bins; bin++) {
+                    float v = src[bin * wf->freq_osr];
+
+                    if (v < w->db_min) {
+                        dst[bin] = 0;
+                    } else if (v >= w->db_max) {
+                        dst[bin] = 255;
+                    } else {
+                        uint32_t cell = (float_bits(v) >> DB_CELL_SHIFT) - w->db_cell_min;
+
+                        dst[bin] = w->db_cell_lo[cell] + (v >= w->db_cell_step[cell]);
+                    }
+                }
+            }
+
+            offset += wf->num_bins;
+        }
+    }
+
+    wf->num_blocks++;
+
+    return true;
+}
+
+/**
+ * Quantize with log10f(), for benchmark and self check
+ */
+void ft8_wf_set_reference(ft8_wf_t w, bool on) {
+    w->reference = on;
+}
+
+void ft8_wf_reset(ft8_wf_t w) {
+    w->wf.num_blocks = 0;
+}
@@ -0,0 +1,36 @@
+/*
+ *  SPDX-License-Identifier: LGPL-2.1-or-later
+ *
+ *  Xiegu X6100 LVGL GUI
+ *
+ *  Copyright (c) 2022-2023 Belousov Oleg aka R1CBU
+ */
+
+#pragma once
+
+#include "ft8/decode.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <complex.h>
+
+/*
+ * FT8/FT4 slot waterfall for the decoder. Audio (analytic signal, already
+ * decimated) comes one symbol block at a time, every block adds time_osr
+ * FFTs of frequency oversampled magnitudes, quantized to 0.5 dB by a table
+ * instead of log10f(). Memory of the sync search is allocated with it.
+ */
+
+typedef struct ft8_wf_s * ft8_wf_t;
+
+ft8_wf_t ft8_wf_create(ftx_protocol_t protocol, uint32_t sample_rate, uint8_t time_osr, uint8_t freq_osr);
+void ft8_wf_destroy(ft8_wf_t w);
+
+waterfall_t * ft8_wf_waterfall(ft8_wf_t w);
+sync_workspace_t * ft8_wf_sync_workspace(ft8_wf_t w);
+uint32_t ft8_wf_block_size(ft8_wf_t w);
+
+bool ft8_wf_process(ft8_wf_t w, float complex *frame);
+void ft8_wf_reset(ft8_wf_t w);
+
+void ft8_wf_set_reference(ft8_wf_t w, bool on);
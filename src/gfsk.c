@@ -14,8 +14,29 @@
 #include "audio.h"
 
 #define GFSK_CONST_K    5.336446f
+#define GFSK_AMPLITUDE  (32767.0f * 0.8f)
 
-static void gfsk_pulse(uint16_t n_spsym, float symbol_bt, float *pulse) {
+#define SINE_BITS       10
+#define SINE_SIZE       (1 << SINE_BITS)
+#define SINE_FRAC_BITS  (32 - SINE_BITS)
+
+struct gfsk_s {
+    uint32_t        n_spsym;        /* Samples per symbol */
+    uint32_t        n_ramp;         /* Samples of envelope shaping at the begin and end */
+
+    float           *pulse;         /* 3 * n_spsym, in phase increment units per tone */
+    float           *ramp;
+    float           sine[SINE_SIZE + 1];
+
+    const uint8_t   *symbols;
+    uint16_t        n_sym;
+    uint32_t        base;           /* Phase increment of f0 */
+    uint32_t        phase;          /* Full turn is 2^32 */
+    uint32_t        pos;
+    uint32_t        n_wave;
+};
+
+static void gfsk_pulse(uint32_t n_spsym, float symbol_bt, float *pulse) {
     for (uint32_t i = 0; i < 3 * n_spsym; i++) {
         float t = i / (float)n_spsym - 1.5f;
         float arg1 = GFSK_CONST_K * symbol_bt * (t + 0.5f);
@@ -25,60 +46,94 @@ static void gfsk_pulse(uint16_t n_spsym, float symbol_bt, float *pulse) {
     }
 }
 
-int16_t * gfsk_synth(const uint8_t *symbols, uint16_t n_sym, float f0, float symbol_bt, float symbol_period, uint32_t *n_samples) {
-    uint32_t    n_spsym = (uint32_t)(0.5f + AUDIO_PLAY_RATE * symbol_period);  /* Samples per symbol */
-    uint32_t    n_wave = n_sym * n_spsym;                                      /* Number of output samples */
-    float       hmod = 1.0f;
-    float       dphi_peak = 2 * M_PI * hmod / n_spsym;
-    float       dphi[n_wave + 2 * n_spsym];
-    int16_t     *samples = malloc(sizeof(int16_t) * n_wave);
+gfsk_t gfsk_create(float symbol_bt, float symbol_period) {
+    gfsk_t g = calloc(1, sizeof(struct gfsk_s));
 
-    *n_samples = n_wave;
+    g->n_spsym = (uint32_t)(0.5f + AUDIO_PLAY_RATE * symbol_period);
+    g->n_ramp = g->n_spsym / 8;
 
-    /* Shift frequency up by f0 */
+    /* hmod = 1, one tone step is one turn per symbol */
 
-    for (uint32_t i = 0; i < n_wave + 2 * n_spsym; i++) {
-        dphi[i] = 2 * M_PI * f0 / AUDIO_PLAY_RATE;
-    }
+    float tone_step = 4294967296.0f / g->n_spsym;
 
-    float pulse[3 * n_spsym];
+    g->pulse = malloc(3 * g->n_spsym * sizeof(float));
+    gfsk_pulse(g->n_spsym, symbol_bt, g->pulse);
 
-    gfsk_pulse(n_spsym, symbol_bt, pulse);
+    for (uint32_t i = 0; i < 3 * g->n_spsym; i++) {
+        g->pulse[i] *= tone_step;
+    }
 
-    for (uint32_t i = 0; i < n_sym; i++) {
-        int ib = i * n_spsym;
+    g->ramp = malloc(g->n_ramp * sizeof(float));
 
-        for (uint32_t j = 0; j < 3 * n_spsym; j++) {
-            dphi[j + ib] += dphi_peak * symbols[i] * pulse[j];
-        }
+    for (uint32_t i = 0; i < g->n_ramp; i++) {
+        g->ramp[i] = (1 - cosf(2 * M_PI * i / (2 * g->n_ramp))) / 2;
     }
 
-    /* Add dummy symbols at beginning and end with tone values equal to 1st and last symbol, respectively */
-
-    for (uint32_t j = 0; j < 2 * n_spsym; j++) {
-        dphi[j] += dphi_peak * pulse[j + n_spsym] * symbols[0];
-        dphi[j + n_sym * n_spsym] += dphi_peak * pulse[j] * symbols[n_sym - 1];
+    for (uint32_t i = 0; i <= SINE_SIZE; i++) {
+        g->sine[i] = sinf(2 * M_PI * i / SINE_SIZE) * GFSK_AMPLITUDE;
     }
 
-    /* Calculate and insert the audio waveform */
+    return g;
+}
 
-    float phi = 0;
+void gfsk_destroy(gfsk_t g) {
+    free(g->pulse);
+    free(g->ramp);
+    free(g);
+}
 
-    for (uint32_t k = 0; k < n_wave; k++) { /* Don't include dummy symbols */
-        samples[k] = sinf(phi) * 32767.0f * 0.8f;
-        phi = fmodf(phi + dphi[k + n_spsym], 2 * M_PI);
-    }
+/**
+ * Start a new message at f0 Hz. Symbols must stay valid until it is read out
+ */
+void gfsk_start(gfsk_t g, const uint8_t *symbols, uint16_t n_sym, float f0) {
+    g->symbols = symbols;
+    g->n_sym = n_sym;
+    g->base = (uint32_t) (f0 / AUDIO_PLAY_RATE * 4294967296.0);
+    g->phase = 0;
+    g->pos = 0;
+    g->n_wave = n_sym * g->n_spsym;
+}
+
+/**
+ * Make up to max next samples of the message. Returns 0 at the end
+ */
+size_t gfsk_read(gfsk_t g, int16_t *samples, size_t max) {
+    size_t n = 0;
+
+    while (n < max && g->pos < g->n_wave) {
+        uint32_t    sym = g->pos / g->n_spsym;
+        uint32_t    j = g->pos % g->n_spsym;
+        uint32_t    end = g->pos - j + g->n_spsym;
 
-    /* Apply envelope shaping to the first and last symbols */
+        /* Pulses of the previous, current and next symbols. The first and last ones are repeated at the ends */
 
-    int n_ramp = n_spsym / 8;
+        float       prev = g->symbols[sym > 0 ? sym - 1 : 0];
+        float       cur = g->symbols[sym];
+        float       next = g->symbols[sym + 1 < g->n_sym ? sym + 1 : sym];
 
-    for (uint32_t i = 0; i < n_ramp; i++) {
-        float env = (1 - cosf(2 * M_PI * i / (2 * n_ramp))) / 2;
+        const float *p_next = g->pulse + j;
+        const float *p_cur = p_next + g->n_spsym;
+        const float *p_prev = p_cur + g->n_spsym;
 
-        samples[i] *= env;
-        samples[n_wave - 1 - i] *= env;
+        if (end - g->pos > max - n) {
+            end = g->pos + (max - n);
+        }
+
+        for (uint32_t k = 0; g->pos < end; k++, g->pos++, n++) {
+            uint32_t    index = g->phase >> SINE_FRAC_BITS;
+            float       frac = (g->phase & ((1 << SINE_FRAC_BITS) - 1)) * (1.0f / (1 << SINE_FRAC_BITS));
+            float       x = g->sine[index] + (g->sine[index + 1] - g->sine[index]) * frac;
+
+            if (g->pos < g->n_ramp) {
+                x = (int16_t) x * g->ramp[g->pos];
+            } else if (g->pos >= g->n_wave - g->n_ramp) {
+                x = (int16_t) x * g->ramp[g->n_wave - 1 - g->pos];
+            }
+
+            samples[n] = x;
+            g->phase += g->base + (uint32_t) (p_prev[k] * prev + p_cur[k] * cur + p_next[k] * next);
+        }
     }
 
-    return samples;
+    return n;
 }
@@ -9,8 +9,21 @@
 #pragma once
 
 #include <stdint.h>
+#include <stddef.h>
 
 #define FT8_SYMBOL_BT   2.0f
 #define FT4_SYMBOL_BT   1.0f
 
-int16_t * gfsk_synth(const uint8_t *symbols, uint16_t n_sym, float f0, float symbol_bt, float symbol_period, uint32_t *n_samples);
+/*
+ * Streaming GFSK synthesizer for FT8/FT4 TX. The Gaussian pulse is computed
+ * once per protocol in gfsk_create(), the waveform is made on the fly in
+ * chunks of any size, so memory does not depend on the message length.
+ */
+
+typedef struct gfsk_s * gfsk_t;
+
+gfsk_t gfsk_create(float symbol_bt, float symbol_period);
+void gfsk_destroy(gfsk_t g);
+
+void gfsk_start(gfsk_t g, const uint8_t *symbols, uint16_t n_sym, float f0);
+size_t gfsk_read(gfsk_t g, int16_t *samples, size_t max);
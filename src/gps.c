@@ -44,10 +44,7 @@ static void data_receive() {
             }
             status = GPS_STATUS_WORKING;
             if (dialog_gps->run) {
-                struct gps_data_t *msg = malloc(sizeof(struct gps_data_t));
-
-                memcpy(msg, &gpsdata, sizeof(*msg));
-                event_send(dialog_gps->obj, EVENT_GPS, msg);
+                event_send_data(dialog_gps->obj, EVENT_GPS, &gpsdata, sizeof(gpsdata));
             }
         }
     }
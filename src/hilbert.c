@@ -0,0 +1,113 @@
+/*
+ *  SPDX-License-Identifier: LGPL-2.1-or-later
+ *
+ *  Xiegu X6100 LVGL GUI
+ *
+ *  Copyright (c) 2022-2023 Belousov Oleg aka R1CBU
+ */
+
+#include "hilbert.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <liquid/liquid.h>
+
+#define BLOCK   512
+
+struct hilbert_s {
+    size_t          len;            /* Filter length, 4 * m + 1 */
+    size_t          delay;          /* Of the real part */
+    float           gain;           /* Of the real part */
+
+    size_t          num_taps;       /* Non zero taps of the imaginary part */
+    size_t          *tap_delay;
+    float           *tap;
+
+    float           *buf;           /* len - 1 history samples, then block */
+    float           *im;
+};
+
+/**
+ * Coefficients come from the impulse response of liquid firhilbf itself, so they are the same
+ */
+hilbert_t hilbert_create(unsigned int m, float as) {
+    hilbert_t       h = calloc(1, sizeof(struct hilbert_s));
+    firhilbf        ref = firhilbf_create(m, as);
+
+    h->len = 4 * m + 1;
+    h->tap_delay = malloc(h->len * sizeof(size_t));
+    h->tap = malloc(h->len * sizeof(float));
+
+    for (size_t i = 0; i < h->len; i++) {
+        float complex y;
+
+        firhilbf_r2c_execute(ref, i == 0 ? 1.0f : 0.0f, &y);
+
+        if (fabsf(crealf(y)) > fabsf(h->gain)) {
+            h->gain = crealf(y);
+            h->delay = i;
+        }
+
+        if (cimagf(y) != 0.0f) {
+            h->tap_delay[h->num_taps] = i;
+            h->tap[h->num_taps] = cimagf(y);
+            h->num_taps++;
+        }
+    }
+
+    firhilbf_destroy(ref);
+
+    h->buf = calloc(h->len - 1 + BLOCK, sizeof(float));
+    h->im = malloc(BLOCK * sizeof(float));
+
+    return h;
+}
+
+void hilbert_destroy(hilbert_t h) {
+    free(h->tap_delay);
+    free(h->tap);
+    free(h->buf);
+    free(h->im);
+    free(h);
+}
+
+static void execute_block(hilbert_t h, const float *x, size_t n, float complex *y) {
+    const size_t    hist = h->len - 1;
+    float           *cur = h->buf + hist;   /* cur[k - d] is x[k] delayed by d */
+    float           *im = h->im;
+
+    memcpy(cur, x, n * sizeof(float));
+    memset(im, 0, n * sizeof(float));
+
+    /* Tap by tap over the whole block, it vectorizes */
+
+    for (size_t t = 0; t < h->num_taps; t++) {
+        const float *src = cur - h->tap_delay[t];
+        const float tap = h->tap[t];
+
+        for (size_t k = 0; k < n; k++) {
+            im[k] += tap * src[k];
+        }
+    }
+
+    const float *re = cur - h->delay;
+
+    for (size_t k = 0; k < n; k++) {
+        y[k] = h->gain * re[k] + I * im[k];
+    }
+
+    memmove(h->buf, h->buf + n, hist * sizeof(float));
+}
+
+void hilbert_execute(hilbert_t h, const float *x, size_t n, float complex *y) {
+    while (n) {
+        size_t part = n < BLOCK ? n : BLOCK;
+
+        execute_block(h, x, part, y);
+
+        x += part;
+        y += part;
+        n -= part;
+    }
+}
@@ -0,0 +1,25 @@
+/*
+ *  SPDX-License-Identifier: LGPL-2.1-or-later
+ *
+ *  Xiegu X6100 LVGL GUI
+ *
+ *  Copyright (c) 2022-2023 Belousov Oleg aka R1CBU
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <complex.h>
+
+/*
+ * Block real to complex (analytic signal) converter, same output as
+ * liquid firhilbf_r2c_execute() per sample. Half-band filter: the real part is
+ * the delayed input, the imaginary one uses only the odd taps.
+ */
+
+typedef struct hilbert_s * hilbert_t;
+
+hilbert_t hilbert_create(unsigned int m, float as);
+void hilbert_destroy(hilbert_t h);
+
+void hilbert_execute(hilbert_t h, const float *x, size_t n, float complex *y);
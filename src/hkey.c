@@ -21,10 +21,7 @@ static event_hkey_t     event = { .state = HKEY_RELEASE };
 static lv_timer_t       *timer = NULL;
 
 static void hkey_event() {
-    event_hkey_t    *e = malloc(sizeof(event_hkey_t));
-    
-    *e = event;
-    event_send(lv_scr_act(), EVENT_HKEY, (void*) e);
+    event_send_data(lv_scr_act(), EVENT_HKEY, &event, sizeof(event));
 }
 
 static void hkey_key(int32_t key) {
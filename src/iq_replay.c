@@ -0,0 +1,191 @@
+/*
+ *  SPDX-License-Identifier: LGPL-2.1-or-later
+ *
+ *  Xiegu X6100 LVGL GUI
+ *
+ *  Copyright (c) 2022-2023 Belousov Oleg aka R1CBU
+ */
+
+#include "iq_replay.h"
+
+#include "lvgl/lvgl.h"
+#include "radio.h"
+#include "dsp.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define FRAME_BYTES     (RADIO_SAMPLES * sizeof(float complex))
+#define FRAME_NSEC      ((uint64_t) RADIO_SAMPLES * 1000000000L / IQ_REPLAY_RATE)
+
+struct iq_replay_s {
+    float complex   *data;
+    size_t          map_size;
+    size_t          frames;
+    size_t          pos;
+};
+
+static iq_replay_t  replay = NULL;
+static bool         replay_realtime = true;
+
+static FILE         *capture = NULL;
+
+iq_replay_t iq_replay_open(const char *path) {
+    int fd = open(path, O_RDONLY);
+
+    if (fd < 0) {
+        LV_LOG_ERROR("Can't open IQ file %s: %s", path, strerror(errno));
+        return NULL;
+    }
+
+    struct stat st;
+
+    if (fstat(fd, &st) < 0 || st.st_size < FRAME_BYTES) {
+        LV_LOG_ERROR("IQ file %s is too short", path);
+        close(fd);
+        return NULL;
+    }
+
+    size_t  frames = st.st_size / FRAME_BYTES;
+    size_t  map_size = frames * FRAME_BYTES;
+
+    /* Private writable mapping: DSP gets a plain buffer, file stays untouched */
+
+    void *data = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+
+    close(fd);
+
+    if (data == MAP_FAILED) {
+        LV_LOG_ERROR("Can't map IQ file %s: %s", path, strerror(errno));
+        return NULL;
+    }
+
+    madvise(data, map_size, MADV_SEQUENTIAL);
+
+    iq_replay_t r = (iq_replay_t) malloc(sizeof(struct iq_replay_s));
+
+    if (!r) {
+        LV_LOG_ERROR("Can't allocate IQ replay of %s", path);
+        munmap(data, map_size);
+        return NULL;
+    }
+
+    r->data = data;
+    r->map_size = map_size;
+    r->frames = frames;
+    r->pos = 0;
+
+    return r;
+}
+
+void iq_replay_close(iq_replay_t r) {
+    munmap(r->data, r->map_size);
+    free(r);
+}
+
+size_t iq_replay_frames(iq_replay_t r) {
+    return r->frames;
+}
+
+/**
+ * Return next RADIO_SAMPLES frame, the capture is looped
+ */
+float complex * iq_replay_next(iq_replay_t r) {
+    float complex *frame = r->data + r->pos * RADIO_SAMPLES;
+
+    r->pos = (r->pos + 1) % r->frames;
+
+    return frame;
+}
+
+void iq_replay_rewind(iq_replay_t r) {
+    r->pos = 0;
+}
+
+static void * replay_thread(void *arg) {
+    struct timespec next;
+
+    clock_gettime(CLOCK_MONOTONIC, &next);
+
+    while (true) {
+        dsp_samples(iq_replay_next(replay), RADIO_SAMPLES, false);
+
+        if (replay_realtime) {
+            next.tv_nsec += FRAME_NSEC;
+
+            if (next.tv_nsec >= 1000000000L) {
+                next.tv_nsec -= 1000000000L;
+                next.tv_sec++;
+            }
+
+            clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Feed DSP from IQ file instead of baseband flow
+ */
+bool iq_replay_start(const char *path, bool realtime) {
+    replay = iq_replay_open(path);
+
+    if (!replay) {
+        return false;
+    }
+
+    replay_realtime = realtime;
+
+    LV_LOG_USER("IQ replay %s: %zu frames, %s", path, replay->frames, realtime ? "realtime" : "fast");
+
+    pthread_t   thread;
+    int         err = pthread_create(&thread, NULL, replay_thread, NULL);
+
+    if (err) {
+        LV_LOG_ERROR("Can't start IQ replay: %s", strerror(err));
+        iq_replay_close(replay);
+        replay = NULL;
+        return false;
+    }
+
+    pthread_detach(thread);
+
+    return true;
+}
+
+bool iq_capture_open(const char *path) {
+    capture = fopen(path, "wb");
+
+    if (!capture) {
+        LV_LOG_ERROR("Can't create IQ capture %s: %s", path, strerror(errno));
+        return false;
+    }
+
+    return true;
+}
+
+void iq_capture_put(float complex *samples) {
+    if (capture) {
+        fwrite(samples, sizeof(float complex), RADIO_SAMPLES, capture);
+    }
+}
+
+/**
+ * Called from the radio thread, the same one that puts samples
+ */
+void iq_capture_close() {
+    if (capture) {
+        fclose(capture);
+        capture = NULL;
+    }
+}
@@ -0,0 +1,33 @@
+/*
+ *  SPDX-License-Identifier: LGPL-2.1-or-later
+ *
+ *  Xiegu X6100 LVGL GUI
+ *
+ *  Copyright (c) 2022-2023 Belousov Oleg aka R1CBU
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <liquid/liquid.h>
+
+/* IQ stream rate of the baseband flow (100 kHz span) */
+
+#define IQ_REPLAY_RATE  100000
+
+/* Capture file is a raw sequence of RADIO_SAMPLES frames of native float complex (cf32) */
+
+typedef struct iq_replay_s * iq_replay_t;
+
+iq_replay_t iq_replay_open(const char *path);
+void iq_replay_close(iq_replay_t replay);
+size_t iq_replay_frames(iq_replay_t replay);
+float complex * iq_replay_next(iq_replay_t replay);
+void iq_replay_rewind(iq_replay_t replay);
+
+bool iq_replay_start(const char *path, bool realtime);
+
+bool iq_capture_open(const char *path);
+void iq_capture_put(float complex *samples);
+void iq_capture_close();
@@ -119,6 +119,9 @@ params_t params = {
     .ft8_band               = 5,
     .ft8_tx_freq            = { .x = 1325,      .name = "ft8_tx_freq" },
     .ft8_auto               = { .x = true,      .name = "ft8_auto" },
+    .ft8_osd                = { .x = true,      .name = "ft8_osd" },
+    .ft8_multipass          = { .x = true,      .name = "ft8_multipass" },
+    .ft8_early              = { .x = true,      .name = "ft8_early" },
     .ft8_output_gain_offset = 0.0f,
 
     .long_gen               = ACTION_SCREENSHOT,
@@ -381,6 +384,9 @@ static bool params_load() {
         if (params_load_bool(&params.waterfall_zoom, name, i)) continue;
         if (params_load_bool(&params.spmode, name, i)) continue;
         if (params_load_bool(&params.ft8_auto, name, i)) continue;
+        if (params_load_bool(&params.ft8_osd, name, i)) continue;
+        if (params_load_bool(&params.ft8_multipass, name, i)) continue;
+        if (params_load_bool(&params.ft8_early, name, i)) continue;
 
         if (params_load_uint8(&params.voice_mode, name, i)) continue;
         if (params_load_uint8(&params.voice_lang, name, i)) continue;
@@ -551,6 +557,9 @@ static void params_save() {
     params_save_bool(&params.waterfall_zoom);
     params_save_bool(&params.spmode);
     params_save_bool(&params.ft8_auto);
+    params_save_bool(&params.ft8_osd);
+    params_save_bool(&params.ft8_multipass);
+    params_save_bool(&params.ft8_early);
 
     params_save_str(&params.qth);
     params_save_str(&params.callsign);
@@ -191,6 +191,9 @@ typedef struct {
     uint8_t             ft8_band;
     params_uint16_t     ft8_tx_freq;
     params_bool_t       ft8_auto;
+    params_bool_t       ft8_osd;
+    params_bool_t       ft8_multipass;
+    params_bool_t       ft8_early;
 
     // Temporal fix for different output power on FT8
     float               ft8_output_gain_offset;
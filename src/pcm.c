@@ -0,0 +1,272 @@
+/*
+ *  SPDX-License-Identifier: LGPL-2.1-or-later
+ *
+ *  Xiegu X6100 LVGL GUI
+ *
+ *  Copyright (c) 2022-2023 Belousov Oleg aka R1CBU
+ */
+
+#define _GNU_SOURCE
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pcm.h"
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#define DC_POLE     0.999f  /* About 7 Hz corner at 44.1 kHz */
+
+static inline int16_t saturate(int32_t x, int32_t min) {
+    x = x > 32767 ? 32767 : x;
+    x = x < min ? min : x;
+
+    return x;
+}
+
+#if defined(__ARM_NEON)
+
+static inline int32x4_t mul_4(int16x4_t x, float32x4_t scale) {
+    return vcvtq_s32_f32(vmulq_f32(vcvtq_f32_s32(vmovl_s16(x)), scale));
+}
+
+/**
+ * 8 samples per iteration, returns count of processed samples
+ */
+static size_t gain_neon(int16_t *dst, const int16_t *src, size_t n, float scale) {
+    float32x4_t v_scale = vdupq_n_f32(scale);
+    int16x8_t   v_min = vdupq_n_s16(-32767);
+    size_t      i;
+
+    for (i = 0; i + 8 <= n; i += 8) {
+        int16x8_t   x = vld1q_s16(src + i);
+        int16x8_t   y = vcombine_s16(vqmovn_s32(mul_4(vget_low_s16(x), v_scale)), vqmovn_s32(mul_4(vget_high_s16(x), v_scale)));
+
+        vst1q_s16(dst + i, vmaxq_s16(y, v_min));
+    }
+
+    return i;
+}
+
+static size_t to_float_neon(float *dst, const int16_t *src, size_t n) {
+    size_t i;
+
+    for (i = 0; i + 8 <= n; i += 8) {
+        int16x8_t x = vld1q_s16(src + i);
+
+        vst1q_f32(dst + i, vcvtq_n_f32_s32(vmovl_s16(vget_low_s16(x)), 15));
+        vst1q_f32(dst + i + 4, vcvtq_n_f32_s32(vmovl_s16(vget_high_s16(x)), 15));
+    }
+
+    return i;
+}
+
+static size_t from_float_neon(int16_t *dst, const float *src, size_t n) {
+    float32x4_t v_scale = vdupq_n_f32(32768.0f);
+    size_t      i;
+
+    for (i = 0; i + 8 <= n; i += 8) {
+        int32x4_t a = vcvtq_s32_f32(vmulq_f32(vld1q_f32(src + i), v_scale));
+        int32x4_t b = vcvtq_s32_f32(vmulq_f32(vld1q_f32(src + i + 4), v_scale));
+
+        vst1q_s16(dst + i, vcombine_s16(vqmovn_s32(a), vqmovn_s32(b)));
+    }
+
+    return i;
+}
+
+static size_t mix_neon(int16_t *dst, const int16_t *src, size_t n, float scale) {
+    float32x4_t v_scale = vdupq_n_f32(scale);
+    size_t      i;
+
+    for (i = 0; i + 8 <= n; i += 8) {
+        int16x8_t   x = vld1q_s16(src + i);
+        int16x8_t   d = vld1q_s16(dst + i);
+        int32x4_t   lo = vaddq_s32(vmovl_s16(vget_low_s16(d)), mul_4(vget_low_s16(x), v_scale));
+        int32x4_t   hi = vaddq_s32(vmovl_s16(vget_high_s16(d)), mul_4(vget_high_s16(x), v_scale));
+
+        vst1q_s16(dst + i, vcombine_s16(vqmovn_s32(lo), vqmovn_s32(hi)));
+    }
+
+    return i;
+}
+
+static size_t peak_neon(uint16_t *peak, const int16_t *src, size_t n) {
+    uint16x8_t  v_peak = vdupq_n_u16(0);
+    size_t      i;
+
+    /* abs(-32768) wraps to 0x8000, which is 32768 as unsigned */
+
+    for (i = 0; i + 8 <= n; i += 8) {
+        v_peak = vmaxq_u16(v_peak, vreinterpretq_u16_s16(vabsq_s16(vld1q_s16(src + i))));
+    }
+
+    uint16x4_t m = vpmax_u16(vget_low_u16(v_peak), vget_high_u16(v_peak));
+
+    m = vpmax_u16(m, m);
+    m = vpmax_u16(m, m);
+
+    *peak = vget_lane_u16(m, 0);
+
+    return i;
+}
+
+#endif
+
+/**
+ * Amplitude scale of gain in dB, as power ratio (10^(db/10)) like the gain params
+ */
+float pcm_db_scale(float db) {
+    return exp10f(db / 10.0f);
+}
+
+/**
+ * Reference versions, for benchmark and self check
+ */
+void pcm_gain_scalar(int16_t *dst, const int16_t *src, size_t n, float scale) {
+    size_t i = 0;
+
+    /* Whole blocks read before write, so dst may be src and the compiler vectorizes them even at -O2 */
+
+    for (; i + 8 <= n; i += 8) {
+        int16_t x[8];
+
+        for (size_t k = 0; k < 8; k++) {
+            x[k] = saturate(src[i + k] * scale, -32767);
+        }
+
+        memcpy(dst + i, x, sizeof(x));
+    }
+
+    for (; i < n; i++) {
+        dst[i] = saturate(src[i] * scale, -32767);
+    }
+}
+
+void pcm_to_float_scalar(float *dst, const int16_t *src, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        dst[i] = src[i] / 32768.0f;
+    }
+}
+
+void pcm_from_float_scalar(int16_t *dst, const float *src, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        float x = src[i] * 32768.0f;
+
+        x = x > 32767.0f ? 32767.0f : x;
+        x = x < -32768.0f ? -32768.0f : x;
+
+        dst[i] = x;
+    }
+}
+
+void pcm_mix_scalar(int16_t *dst, const int16_t *src, size_t n, float scale) {
+    for (size_t i = 0; i < n; i++) {
+        dst[i] = saturate(dst[i] + (int32_t) (src[i] * scale), -32768);
+    }
+}
+
+uint16_t pcm_peak_scalar(const int16_t *src, size_t n) {
+    uint16_t peak = 0;
+
+    for (size_t i = 0; i < n; i++) {
+        uint16_t x = abs(src[i]);
+
+        if (x > peak) {
+            peak = x;
+        }
+    }
+
+    return peak;
+}
+
+/**
+ * Multiply by scale, saturated to [-32767, 32767]
+ */
+void pcm_gain(int16_t *dst, const int16_t *src, size_t n, float scale) {
+    size_t done = 0;
+
+#if defined(__ARM_NEON)
+    done = gain_neon(dst, src, n, scale);
+#endif
+
+    pcm_gain_scalar(dst + done, src + done, n - done, scale);
+}
+
+/**
+ * Convert to [-1, 1)
+ */
+void pcm_to_float(float *dst, const int16_t *src, size_t n) {
+    size_t done = 0;
+
+#if defined(__ARM_NEON)
+    done = to_float_neon(dst, src, n);
+#endif
+
+    pcm_to_float_scalar(dst + done, src + done, n - done);
+}
+
+/**
+ * Convert from [-1, 1), saturated
+ */
+void pcm_from_float(int16_t *dst, const float *src, size_t n) {
+    size_t done = 0;
+
+#if defined(__ARM_NEON)
+    done = from_float_neon(dst, src, n);
+#endif
+
+    pcm_from_float_scalar(dst + done, src + done, n - done);
+}
+
+/**
+ * Add src multiplied by scale to dst, saturated
+ */
+void pcm_mix(int16_t *dst, const int16_t *src, size_t n, float scale) {
+    size_t done = 0;
+
+#if defined(__ARM_NEON)
+    done = mix_neon(dst, src, n, scale);
+#endif
+
+    pcm_mix_scalar(dst + done, src + done, n - done, scale);
+}
+
+/**
+ * Largest absolute value
+ */
+uint16_t pcm_peak(const int16_t *src, size_t n) {
+    uint16_t    peak = 0;
+    size_t      done = 0;
+
+#if defined(__ARM_NEON)
+    done = peak_neon(&peak, src, n);
+#endif
+
+    uint16_t tail = pcm_peak_scalar(src + done, n - done);
+
+    return tail > peak ? tail : peak;
+}
+
+/**
+ * One pole DC blocker, y[i] = x[i] - x[i - 1] + pole * y[i - 1]. It is recursive, so scalar only
+ */
+void pcm_dc_block(pcm_dc_t *dc, int16_t *dst, const int16_t *src, size_t n) {
+    float x1 = dc->x1;
+    float y1 = dc->y1;
+
+    for (size_t i = 0; i < n; i++) {
+        float x = src[i];
+
+        y1 = x - x1 + DC_POLE * y1;
+        x1 = x;
+
+        dst[i] = saturate(lrintf(y1), -32768);
+    }
+
+    dc->x1 = x1;
+    dc->y1 = y1;
+}
@@ -0,0 +1,38 @@
+/*
+ *  SPDX-License-Identifier: LGPL-2.1-or-later
+ *
+ *  Xiegu X6100 LVGL GUI
+ *
+ *  Copyright (c) 2022-2023 Belousov Oleg aka R1CBU
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* 16 bit audio kernels: gain, conversion to and from float, mixing, peak and DC removal. dst may be src */
+
+typedef struct {
+    float   x1;
+    float   y1;
+} pcm_dc_t;
+
+float pcm_db_scale(float db);
+
+void pcm_gain(int16_t *dst, const int16_t *src, size_t n, float scale);
+void pcm_gain_scalar(int16_t *dst, const int16_t *src, size_t n, float scale);
+
+void pcm_to_float(float *dst, const int16_t *src, size_t n);
+void pcm_to_float_scalar(float *dst, const int16_t *src, size_t n);
+
+void pcm_from_float(int16_t *dst, const float *src, size_t n);
+void pcm_from_float_scalar(int16_t *dst, const float *src, size_t n);
+
+void pcm_mix(int16_t *dst, const int16_t *src, size_t n, float scale);
+void pcm_mix_scalar(int16_t *dst, const int16_t *src, size_t n, float scale);
+
+uint16_t pcm_peak(const int16_t *src, size_t n);
+uint16_t pcm_peak_scalar(const int16_t *src, size_t n);
+
+void pcm_dc_block(pcm_dc_t *dc, int16_t *dst, const int16_t *src, size_t n);
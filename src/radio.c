@@ -16,11 +16,13 @@
 #include "dialog_swrscan.h"
 #include "cw.h"
 #include "pubsub_ids.h"
+#include "iq_replay.h"
 
 #include <aether_radio/x6100_control/low/flow.h>
 #include <aether_radio/x6100_control/low/gpio.h>
 
 #include <unistd.h>
+#include <stdlib.h>
 #include <stdio.h>
 #include <pthread.h>
 #include <string.h>
@@ -71,6 +73,7 @@ bool radio_tick() {
             delay = 0;
             clock_update_power(pack->vext * 0.1f, pack->vbat*0.1f, pack->batcap, pack->flag.charging);
         }
+        iq_capture_put(pack->samples);
         dsp_samples(pack->samples, RADIO_SAMPLES, pack->flag.tx);
 
         switch (state) {
@@ -130,6 +133,7 @@ bool radio_tick() {
                 break;
 
             case RADIO_POWEROFF:
+                iq_capture_close();
                 x6100_control_poweroff();
                 state = RADIO_OFF;
                 break;
@@ -243,6 +247,14 @@ void radio_bb_reset() {
 }
 
 void radio_init(radio_state_change_t tx_cb, radio_state_change_t rx_cb, radio_state_change_t atu_update_cb) {
+    const char *replay_path = getenv("X6100_IQ_REPLAY");
+
+    if (replay_path) {
+        /* Offline mode: recorded IQ drives DSP instead of the baseband */
+        iq_replay_start(replay_path, getenv("X6100_IQ_REPLAY_FAST") == NULL);
+        return;
+    }
+
     if (!x6100_gpio_init())
         return;
 
@@ -253,6 +265,12 @@ void radio_init(radio_state_change_t tx_cb, radio_state_change_t rx_cb, radio_st
     if (!x6100_flow_init())
         return;
 
+    const char *capture_path = getenv("X6100_IQ_CAPTURE");
+
+    if (capture_path) {
+        iq_capture_open(capture_path);
+    }
+
     x6100_gpio_set(x6100_pin_wifi, 1);          /* WiFi off */
     x6100_gpio_set(x6100_pin_morse_key, 1);     /* Morse key off */
 
@@ -8,18 +8,25 @@
 
 #include <time.h>
 #include <sys/time.h>
+#include <pthread.h>
 #include <sndfile.h>
 
 #include "audio.h"
+#include "pcm.h"
+#include "dsp.h"
 #include "dialog_recorder.h"
 #include "recorder.h"
 #include "msg.h"
 #include "params/params.h"
 
+#define BUF_SIZE 1024
+
 char            *recorder_path = "/mnt/rec";
 
-static bool     on = false;
-static SNDFILE  *file = NULL;
+static bool                 on = false;
+static SNDFILE              *file = NULL;
+static pthread_t            thread;
+static audio_ring_reader_t  reader;
 
 static bool create_file() {
     SF_INFO sfinfo;
@@ -53,8 +60,46 @@ static bool create_file() {
     return true;
 }
 
+/**
+ * Capture audio consumer. Real part of the analytic signal is the delayed input
+ */
+static void * record_thread(void *arg) {
+    float   real[BUF_SIZE];
+    int16_t buf[BUF_SIZE];
+
+    while (on) {
+        float complex   *audio;
+        size_t          n;
+
+        audio_ring_wait(reader, 1, 100);
+
+        float scale = params.rec_gain_db != 0 ? pcm_db_scale(params.rec_gain_db) : 1.0f;
+
+        while ((n = audio_ring_peek(reader, &audio, BUF_SIZE)) > 0) {
+            for (size_t i = 0; i < n; i++) {
+                real[i] = crealf(audio[i]);
+            }
+
+            audio_ring_release(reader, n);
+            pcm_from_float(buf, real, n);
+
+            if (scale != 1.0f) {
+                pcm_gain(buf, buf, n, scale);
+            }
+
+            sf_write_short(file, buf, n);
+        }
+    }
+
+    return NULL;
+}
+
 void recorder_set_on(bool x) {
     if (x) {
+        if (on) {
+            return;
+        }
+
         if (!create_file()) {
             msg_set_text_fmt("Problem with create file");
             return;
@@ -62,9 +107,17 @@ void recorder_set_on(bool x) {
             msg_set_text_fmt("Recorder is on");
         }
         on = true;
+        reader = audio_ring_reader_create(dsp_audio_ring(), "Recorder");
+        pthread_create(&thread, NULL, record_thread, NULL);
     } else {
+        if (!on) {
+            return;
+        }
+
         msg_set_text_fmt("Recorder is off");
         on = false;
+        pthread_join(thread, NULL);
+        audio_ring_reader_destroy(reader);
         sf_close(file);
     }
 
@@ -74,18 +127,3 @@ void recorder_set_on(bool x) {
 bool recorder_is_on() {
     return on;
 }
-
-void recorder_put_audio_samples(size_t nsamples, int16_t *samples) {
-    int16_t *out_samples;
-    if (params.rec_gain_db != 0) {
-        *out_samples = malloc(nsamples * sizeof(*out_samples));
-        audio_gain_db(samples, nsamples, params.rec_gain_db, out_samples);
-    } else {
-        out_samples = samples;
-    }
-
-    sf_write_short(file, out_samples, nsamples);
-    if (params.rec_gain_db != 0) {
-        free(out_samples);
-    }
-}
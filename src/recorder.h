@@ -15,4 +15,3 @@ extern char *recorder_path;
 
 void recorder_set_on(bool on);
 bool recorder_is_on();
-void recorder_put_audio_samples(size_t nsamples, int16_t *samples);
@@ -0,0 +1,176 @@
+/*
+ *  SPDX-License-Identifier: LGPL-2.1-or-later
+ *
+ *  Xiegu X6100 LVGL GUI
+ *
+ *  Copyright (c) 2022-2023 Belousov Oleg aka R1CBU
+ */
+
+#include "render.h"
+#include "backlight.h"
+#include "util.h"
+
+#include <time.h>
+
+#define BUDGET_PCT      40      /* Max share of frame period, spent for the view */
+#define COST_BETA       0.9f
+#define FPS_WINDOW_MS   1000
+#define LOG_PERIOD_MS   10000   /* Achieved fps and cost of the views go to the log */
+
+typedef struct {
+    uint8_t     fps;            /* Target */
+    uint16_t    idle_ms;        /* Period with backlight off */
+
+    uint16_t    period_ms;      /* Current, read by radio thread */
+    uint64_t    last_time;
+
+    uint64_t    work_start;
+    uint64_t    draw_start;
+    uint64_t    busy_us;        /* Work and drawing, accumulated in current frame */
+    float       cost_us;        /* Smoothed per frame */
+
+    uint32_t    frames;
+    uint64_t    fps_time;
+    float       fps_achieved;
+} view_t;
+
+static view_t   views[RENDER_LAST] = {
+    [RENDER_SPECTRUM] =  { .fps = 15, .idle_ms = 1000 },
+    [RENDER_WATERFALL] = { .fps = 25, .idle_ms = 200 },
+};
+
+static const char *view_names[RENDER_LAST] = { "spectrum", "waterfall" };
+
+static uint64_t log_time = 0;
+
+static uint64_t now_us() {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint64_t) now.tv_sec * 1000000L + now.tv_nsec / 1000;
+}
+
+static void update_period(view_t *view) {
+    uint32_t period = 1000 / view->fps;
+    uint32_t cost_period = view->cost_us * 100 / BUDGET_PCT / 1000;
+
+    if (cost_period > period) {
+        period = cost_period;
+    }
+
+    view->period_ms = period;
+}
+
+static void draw_begin_cb(lv_event_t * e) {
+    view_t *view = lv_event_get_user_data(e);
+
+    view->draw_start = now_us();
+}
+
+static void draw_end_cb(lv_event_t * e) {
+    view_t *view = lv_event_get_user_data(e);
+
+    if (view->draw_start) {
+        view->busy_us += now_us() - view->draw_start;
+        view->draw_start = 0;
+    }
+}
+
+void render_init() {
+    uint64_t now = get_time();
+
+    for (uint8_t i = 0; i < RENDER_LAST; i++) {
+        view_t *view = &views[i];
+
+        view->last_time = now;
+        view->fps_time = now;
+        update_period(view);
+    }
+}
+
+/**
+ * Measure draw cost of the view object. Several draw passes of one frame are summed.
+ * Must be called before other draw callbacks are added to the object, they are run in order
+ */
+void render_attach(render_view_t view, lv_obj_t *obj) {
+    lv_obj_add_event_cb(obj, draw_begin_cb, LV_EVENT_DRAW_MAIN_BEGIN, &views[view]);
+    lv_obj_add_event_cb(obj, draw_end_cb, LV_EVENT_DRAW_POST_END, &views[view]);
+}
+
+/**
+ * Called from radio thread. True when PSD for the view should be produced
+ */
+bool render_due(render_view_t view, uint64_t now) {
+    view_t      *v = &views[view];
+    uint16_t    period = v->period_ms;
+
+    if (!backlight_is_on() && period < v->idle_ms) {
+        period = v->idle_ms;
+    }
+
+    if (now - v->last_time > period) {
+        v->last_time = now;
+        return true;
+    }
+
+    return false;
+}
+
+/**
+ * Called from LVGL thread, when a new frame of the view is taken, before work on it
+ */
+void render_frame_begin(render_view_t view) {
+    view_t *v = &views[view];
+
+    /* Draw of previous frame is complete by now */
+
+    v->cost_us = v->cost_us * COST_BETA + v->busy_us * (1.0f - COST_BETA);
+    v->busy_us = 0;
+    update_period(v);
+
+    v->work_start = now_us();
+}
+
+static void log_views(uint64_t now) {
+    if (now - log_time < LOG_PERIOD_MS) {
+        return;
+    }
+
+    log_time = now;
+
+    for (uint8_t i = 0; i < RENDER_LAST; i++) {
+        LV_LOG_INFO("%s: %.1f fps, period %u ms, cost %u us", view_names[i],
+            render_get_fps(i), views[i].period_ms, (uint32_t) views[i].cost_us);
+    }
+}
+
+/**
+ * Called from LVGL thread, when work on the taken frame is done and it is invalidated
+ */
+void render_frame(render_view_t view) {
+    view_t      *v = &views[view];
+    uint64_t    now = get_time();
+
+    if (v->work_start) {
+        v->busy_us += now_us() - v->work_start;
+        v->work_start = 0;
+    }
+
+    v->frames++;
+
+    if (now - v->fps_time >= FPS_WINDOW_MS) {
+        v->fps_achieved = v->frames * 1000.0f / (now - v->fps_time);
+        v->frames = 0;
+        v->fps_time = now;
+    }
+
+    log_views(now);
+}
+
+/**
+ * Frames of the view taken by LVGL per second, over the last second
+ */
+float render_get_fps(render_view_t view) {
+    return views[view].fps_achieved;
+}
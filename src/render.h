@@ -0,0 +1,42 @@
+/*
+ *  SPDX-License-Identifier: LGPL-2.1-or-later
+ *
+ *  Xiegu X6100 LVGL GUI
+ *
+ *  Copyright (c) 2022-2023 Belousov Oleg aka R1CBU
+ */
+
+#pragma once
+
+#include "lvgl/lvgl.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Render scheduler. Owns frame rate of the spectrum and waterfall views.
+ * Radio thread asks if a new PSD is due, LVGL thread reports the cost of each
+ * frame: work on a taken frame between render_frame_begin() and render_frame(),
+ * plus drawing of the view object. Rate goes down when a frame is expensive or
+ * the screen is off. Achieved fps of the views is counted and logged.
+ */
+
+typedef enum {
+    RENDER_SPECTRUM = 0,
+    RENDER_WATERFALL,
+
+    RENDER_LAST
+} render_view_t;
+
+void render_init();
+void render_attach(render_view_t view, lv_obj_t *obj);
+
+/* Radio thread */
+
+bool render_due(render_view_t view, uint64_t now);
+
+/* LVGL thread */
+
+void render_frame_begin(render_view_t view);
+void render_frame(render_view_t view);
+float render_get_fps(render_view_t view);
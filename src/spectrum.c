@@ -18,14 +18,18 @@
 #include "rtty.h"
 #include "recorder.h"
 #include "pubsub_ids.h"
+#include "backlight.h"
+#include "triple_buf.h"
+#include "render.h"
 
 #include <stdlib.h>
-#include <pthread.h>
+#include <string.h>
 
 #define DEFAULT_MIN S4
 #define DEFAULT_MAX S9_20
 #define VISOR_HEIGHT_TX (100 - 61)
 #define VISOR_HEIGHT_RX 100
+#define FRAME_POLL_MS   5
 
 static float            grid_min = DEFAULT_MIN;
 static float            grid_max = DEFAULT_MAX;
@@ -50,7 +54,24 @@ typedef struct {
 
 static peak_t           *spectrum_peak;
 
-static pthread_mutex_t  data_mux;
+/* Trace raster. Only changed columns are repainted and invalidated */
+
+static lv_img_dsc_t     *trace_img = NULL;
+static int16_t          *trace_main = NULL;
+static int16_t          *trace_peak = NULL;
+static int16_t          *trace_new = NULL;
+static lv_coord_t       trace_shift = 0;
+static bool             trace_filled = false;
+static bool             trace_peak_on = false;
+
+/* PSD frame from radio thread */
+
+typedef struct {
+    bool        tx;
+    float       data[SPECTRUM_NFFT];
+} spectrum_frame_t;
+
+static triple_buf_t     frames;
 
 static void zoom_changed_cd(void * s, lv_msg_t * m);
 
@@ -58,84 +79,41 @@ static void spectrum_draw_cb(lv_event_t * e) {
     lv_obj_t            *obj = lv_event_get_target(e);
     lv_draw_ctx_t       *draw_ctx = lv_event_get_draw_ctx(e);
     lv_draw_line_dsc_t  main_line_dsc;
-    lv_draw_line_dsc_t  peak_line_dsc;
 
     if (!spectrum_buf) {
         return;
     }
-    float min, max;
-    if (spectrum_tx) {
-        min = DEFAULT_MIN;
-        max = DEFAULT_MAX;
-    } else {
-        min = grid_min;
-        max = grid_max;
-    }
-
-    /* Lines */
 
     lv_draw_line_dsc_init(&main_line_dsc);
 
     main_line_dsc.color = lv_color_hex(0xAAAAAA);
     main_line_dsc.width = 1;
 
-    lv_draw_line_dsc_init(&peak_line_dsc);
-
-    peak_line_dsc.color = lv_color_hex(0x555555);
-    peak_line_dsc.width = 1;
-
     lv_coord_t x1 = obj->coords.x1;
     lv_coord_t y1 = obj->coords.y1;
 
     lv_coord_t w = lv_obj_get_width(obj);
     lv_coord_t h = lv_obj_get_height(obj);
 
-    x1 += params_lo_offset_get() * zoom_factor * w / width_hz;
-
-    lv_point_t main_a, main_b;
-    lv_point_t peak_a, peak_b;
-
-    if (!params.spectrum_filled) {
-        main_b.x = x1;
-        main_b.y = y1 + h;
-    }
-
-    peak_b.x = x1;
-    peak_b.y = y1 + h;
-
-    for (uint16_t i = 0; i < spectrum_size; i++) {
-        float       v = (spectrum_buf[i] - min) / (max - min);
-        uint16_t    x = i * w / spectrum_size;
-
-        /* Peak */
+    /* Trace */
 
-        if (params.spectrum_peak && !spectrum_tx) {
-            float v_peak = (spectrum_peak[i].val - min) / (max - min);
+    if (trace_img) {
+        lv_draw_img_dsc_t   img_dsc;
+        lv_area_t           area;
 
-            peak_a.x = x1 + x;
-            peak_a.y = y1 + (1.0f - v_peak) * h;
+        lv_draw_img_dsc_init(&img_dsc);
 
-            lv_draw_line(draw_ctx, &peak_line_dsc, &peak_a, &peak_b);
-
-            peak_b = peak_a;
-        }
+        area.x1 = x1 + trace_shift;
+        area.y1 = y1;
+        area.x2 = area.x1 + trace_img->header.w - 1;
+        area.y2 = area.y1 + trace_img->header.h - 1;
 
-        /* Main */
-
-        main_a.x = x1 + x;
-        main_a.y = y1 + (1.0f - v) * h;
-
-        if (params.spectrum_filled) {
-            main_b.x = main_a.x;
-            main_b.y = y1 + h;
-        }
+        lv_draw_img(draw_ctx, &img_dsc, &area, trace_img);
+    }
 
-        lv_draw_line(draw_ctx, &main_line_dsc, &main_a, &main_b);
+    x1 += params_lo_offset_get() * zoom_factor * w / width_hz;
 
-        if (!params.spectrum_filled) {
-            main_b = main_a;
-        }
-    }
+    lv_point_t main_a, main_b;
 
     /* Filter */
 
@@ -236,33 +214,175 @@ static void rx_cb(lv_event_t * e) {
     visor_height = VISOR_HEIGHT_RX;
 }
 
-lv_obj_t * spectrum_init(lv_obj_t * parent) {
-    pthread_mutex_init(&data_mux, NULL);
-    spectrum_buf = malloc(spectrum_size * sizeof(float));
-    spectrum_peak = malloc(spectrum_size * sizeof(peak_t));
-    spectrum_min_max_reset();
+static inline void trace_fill(lv_color_t *col, lv_coord_t stride, int16_t from, int16_t to, lv_color_t color) {
+    if (from > to) {
+        int16_t t = from;
 
-    obj = lv_obj_create(parent);
+        from = to;
+        to = t;
+    }
 
-    lv_obj_add_style(obj, &spectrum_style, 0);
-    lv_obj_add_event_cb(obj, spectrum_draw_cb, LV_EVENT_DRAW_MAIN_END, NULL);
-    lv_obj_add_event_cb(obj, tx_cb, EVENT_RADIO_TX, NULL);
-    lv_obj_add_event_cb(obj, rx_cb, EVENT_RADIO_RX, NULL);
+    for (int16_t y = from; y <= to; y++) {
+        col[y * stride] = color;
+    }
+}
 
-    lv_msg_subscribe(MSG_SPECTRUM_ZOOM_CHANGED, zoom_changed_cd, NULL);
+/**
+ * Paint column x of the raster. Lines go from previous column, the first one starts at the bottom
+ */
+static void trace_column(lv_coord_t x, lv_coord_t w, lv_coord_t h) {
+    lv_color_t  *col = (lv_color_t *) trace_img->data + x;
+    lv_color_t  clear = { .full = 0 };
+    lv_color_t  main_color = lv_color_hex(0xAAAAAA);
+    lv_color_t  peak_color = lv_color_hex(0x555555);
+    int16_t     bottom = h - 1;
 
-    return obj;
+    main_color.ch.alpha = LV_OPA_COVER;
+    peak_color.ch.alpha = LV_OPA_COVER;
+
+    trace_fill(col, w, 0, bottom, clear);
+
+    if (trace_peak_on) {
+        int16_t prev = x ? trace_peak[x - 1] : bottom;
+
+        trace_fill(col, w, LV_MIN(prev, bottom), LV_MIN(trace_peak[x], bottom), peak_color);
+    }
+
+    if (trace_filled) {
+        if (trace_main[x] <= bottom) {
+            trace_fill(col, w, trace_main[x], bottom, main_color);
+        }
+    } else {
+        int16_t prev = x ? trace_main[x - 1] : bottom;
+
+        trace_fill(col, w, LV_MIN(prev, bottom), LV_MIN(trace_main[x], bottom), main_color);
+    }
 }
 
-void spectrum_data(float *data_buf, uint16_t size, bool tx) {
-    uint64_t now = get_time();
+static int16_t trace_level(float val, float min, float max, lv_coord_t h) {
+    int32_t y = (1.0f - (val - min) / (max - min)) * h;
+
+    return LV_CLAMP(0, y, h);
+}
+
+/**
+ * Compute trace per column and repaint columns, which are changed (with their right neighbour,
+ * because of connecting lines)
+ */
+static void trace_update() {
+    lv_coord_t  w = lv_obj_get_width(obj);
+    lv_coord_t  h = lv_obj_get_height(obj);
+
+    if (w <= 0 || h <= 0) {
+        return;
+    }
+
+    bool        full = false;
+
+    if (!trace_img || trace_img->header.w != w || trace_img->header.h != h) {
+        if (trace_img) {
+            lv_img_buf_free(trace_img);
+        }
+
+        trace_img = lv_img_buf_alloc(w, h, LV_IMG_CF_TRUE_COLOR_ALPHA);
+        trace_main = realloc(trace_main, w * sizeof(int16_t));
+        trace_peak = realloc(trace_peak, w * sizeof(int16_t));
+        trace_new = realloc(trace_new, w * sizeof(int16_t));
+
+        full = true;
+    }
+
+    bool        filled = params.spectrum_filled;
+    bool        peak_on = params.spectrum_peak && !spectrum_tx;
+    lv_coord_t  shift = params_lo_offset_get() * zoom_factor * w / width_hz;
+
+    if (filled != trace_filled || peak_on != trace_peak_on || shift != trace_shift) {
+        trace_filled = filled;
+        trace_peak_on = peak_on;
+        trace_shift = shift;
+        full = true;
+    }
+
+    float min, max;
+
+    if (spectrum_tx) {
+        min = DEFAULT_MIN;
+        max = DEFAULT_MAX;
+    } else {
+        min = grid_min;
+        max = grid_max;
+    }
+
+    lv_coord_t  dirty_from = w;
+    lv_coord_t  dirty_to = -1;
+    bool        prev_changed = false;
+
+    /* Peaks first, main trace is painted over them */
+
+    if (peak_on) {
+        for (lv_coord_t x = 0; x < w; x++) {
+            trace_new[x] = trace_level(spectrum_peak[x * spectrum_size / w].val, min, max, h);
+        }
+    }
+
+    for (lv_coord_t x = 0; x < w; x++) {
+        int16_t main_y = trace_level(spectrum_buf[x * spectrum_size / w], min, max, h);
+        bool    changed = full || main_y != trace_main[x] || (peak_on && trace_new[x] != trace_peak[x]);
+
+        trace_main[x] = main_y;
+
+        if (peak_on) {
+            trace_peak[x] = trace_new[x];
+        }
+
+        if (changed || prev_changed) {
+            trace_column(x, w, h);
+
+            if (x < dirty_from) {
+                dirty_from = x;
+            }
+            dirty_to = x;
+        }
+
+        prev_changed = changed;
+    }
+
+    if (dirty_to < 0) {
+        return;
+    }
+
+    lv_img_cache_invalidate_src(trace_img);
+
+    if (full) {
+        lv_obj_invalidate(obj);
+    } else {
+        lv_area_t area;
+
+        area.x1 = obj->coords.x1 + trace_shift + dirty_from;
+        area.y1 = obj->coords.y1;
+        area.x2 = obj->coords.x1 + trace_shift + dirty_to;
+        area.y2 = obj->coords.y2;
+
+        lv_obj_invalidate_area(obj, &area);
+    }
+}
+
+static void frame_timer_cb(lv_timer_t *t) {
+    if (!triple_buf_update(frames)) {
+        return;
+    }
+
+    render_frame_begin(RENDER_SPECTRUM);
 
-    pthread_mutex_lock(&data_mux);
-    spectrum_tx = tx;
-    for (uint16_t i = 0; i < size; i++) {
-        spectrum_buf[i] = data_buf[size - i - 1];
+    spectrum_frame_t    *frame = triple_buf_front(frames);
+    uint64_t            now = get_time();
 
-        if (params.spectrum_peak && !tx) {
+    spectrum_tx = frame->tx;
+
+    for (uint16_t i = 0; i < spectrum_size; i++) {
+        spectrum_buf[i] = frame->data[spectrum_size - i - 1];
+
+        if (params.spectrum_peak && !spectrum_tx) {
             float   v = spectrum_buf[i];
             peak_t  *peak = &spectrum_peak[i];
 
@@ -277,8 +397,49 @@ void spectrum_data(float *data_buf, uint16_t size, bool tx) {
         }
     }
 
-    pthread_mutex_unlock(&data_mux);
-    event_send(obj, LV_EVENT_REFRESH, NULL);
+    /* Raster stays in sync with the screen, so it is not touched while the screen is off */
+
+    if (backlight_is_on()) {
+        trace_update();
+    }
+
+    render_frame(RENDER_SPECTRUM);
+}
+
+lv_obj_t * spectrum_init(lv_obj_t * parent) {
+    frames = triple_buf_create(sizeof(spectrum_frame_t));
+    spectrum_buf = malloc(spectrum_size * sizeof(float));
+    spectrum_peak = malloc(spectrum_size * sizeof(peak_t));
+    spectrum_min_max_reset();
+
+    obj = lv_obj_create(parent);
+    render_attach(RENDER_SPECTRUM, obj);
+
+    lv_obj_add_style(obj, &spectrum_style, 0);
+    lv_obj_add_event_cb(obj, spectrum_draw_cb, LV_EVENT_DRAW_MAIN_END, NULL);
+    lv_obj_add_event_cb(obj, tx_cb, EVENT_RADIO_TX, NULL);
+    lv_obj_add_event_cb(obj, rx_cb, EVENT_RADIO_RX, NULL);
+
+    lv_msg_subscribe(MSG_SPECTRUM_ZOOM_CHANGED, zoom_changed_cd, NULL);
+    lv_timer_create(frame_timer_cb, FRAME_POLL_MS, NULL);
+
+    return obj;
+}
+
+/**
+ * Called from radio thread. Never blocks, older unread frame is replaced
+ */
+void spectrum_data(float *data_buf, uint16_t size, bool tx) {
+    if (!frames) {
+        return;
+    }
+
+    spectrum_frame_t *frame = triple_buf_back(frames);
+
+    frame->tx = tx;
+    memcpy(frame->data, data_buf, size * sizeof(float));
+
+    triple_buf_publish(frames);
 }
 
 void spectrum_min_max_reset() {
@@ -0,0 +1,77 @@
+/*
+ *  SPDX-License-Identifier: LGPL-2.1-or-later
+ *
+ *  Xiegu X6100 LVGL GUI
+ *
+ *  Copyright (c) 2022-2023 Belousov Oleg aka R1CBU
+ */
+
+#include "triple_buf.h"
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdatomic.h>
+
+#define INDEX_MASK  0x03
+#define FRESH       0x04
+
+struct triple_buf_s {
+    uint8_t         *slots[3];
+    uint8_t         back;       /* Owned by producer */
+    uint8_t         front;      /* Owned by consumer */
+    atomic_uchar    middle;     /* Slot index in exchange, with FRESH flag */
+};
+
+triple_buf_t triple_buf_create(size_t size) {
+    triple_buf_t tb = (triple_buf_t) malloc(sizeof(struct triple_buf_s));
+
+    for (uint8_t i = 0; i < 3; i++) {
+        tb->slots[i] = calloc(1, size);
+    }
+
+    tb->back = 0;
+    tb->front = 1;
+    atomic_init(&tb->middle, 2);
+
+    return tb;
+}
+
+void triple_buf_destroy(triple_buf_t tb) {
+    for (uint8_t i = 0; i < 3; i++) {
+        free(tb->slots[i]);
+    }
+    free(tb);
+}
+
+void * triple_buf_back(triple_buf_t tb) {
+    return tb->slots[tb->back];
+}
+
+/**
+ * Hand filled back slot over to consumer, take the stale one for the next frame
+ */
+void triple_buf_publish(triple_buf_t tb) {
+    uint8_t prev = atomic_exchange_explicit(&tb->middle, tb->back | FRESH, memory_order_acq_rel);
+
+    tb->back = prev & INDEX_MASK;
+}
+
+/**
+ * Switch front to the newest published slot. Returns false if nothing new
+ */
+bool triple_buf_update(triple_buf_t tb) {
+    if (!(atomic_load_explicit(&tb->middle, memory_order_relaxed) & FRESH)) {
+        return false;
+    }
+
+    uint8_t prev = atomic_exchange_explicit(&tb->middle, tb->front, memory_order_acq_rel);
+
+    tb->front = prev & INDEX_MASK;
+
+    return true;
+}
+
+void * triple_buf_front(triple_buf_t tb) {
+    return tb->slots[tb->front];
+}
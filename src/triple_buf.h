@@ -0,0 +1,33 @@
+/*
+ *  SPDX-License-Identifier: LGPL-2.1-or-later
+ *
+ *  Xiegu X6100 LVGL GUI
+ *
+ *  Copyright (c) 2022-2023 Belousov Oleg aka R1CBU
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * Lock-free single producer / single consumer triple buffer.
+ * Producer fills back slot and publishes it, consumer always takes the newest
+ * published slot. Intermediate frames are dropped, nobody ever waits.
+ */
+
+typedef struct triple_buf_s * triple_buf_t;
+
+triple_buf_t triple_buf_create(size_t size);
+void triple_buf_destroy(triple_buf_t tb);
+
+/* Producer side */
+
+void * triple_buf_back(triple_buf_t tb);
+void triple_buf_publish(triple_buf_t tb);
+
+/* Consumer side */
+
+bool triple_buf_update(triple_buf_t tb);
+void * triple_buf_front(triple_buf_t tb);
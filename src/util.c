@@ -234,6 +234,54 @@ size_t argmax(float * x, size_t n) {
     return pos;
 }
 
+/**
+ * Find k-th smallest value (quickselect, linear on average).
+ * Array is partially reordered: x[0..k-1] <= x[k] <= x[k+1..n-1]
+ */
+float select_nth(float *x, size_t n, size_t k) {
+    int32_t left = 0;
+    int32_t right = n - 1;
+    float   tmp;
+
+#define SWAP(a, b)  { tmp = x[a]; x[a] = x[b]; x[b] = tmp; }
+
+    while (right > left) {
+        int32_t mid = left + (right - left) / 2;
+
+        /* Median of three as pivot, also gives sentinels for the scans */
+
+        if (x[mid] < x[left]) SWAP(mid, left);
+        if (x[right] < x[left]) SWAP(right, left);
+        if (x[right] < x[mid]) SWAP(right, mid);
+
+        float   pivot = x[mid];
+        int32_t i = left;
+        int32_t j = right;
+
+        while (i <= j) {
+            while (x[i] < pivot) i++;
+            while (x[j] > pivot) j--;
+
+            if (i <= j) {
+                SWAP(i, j);
+                i++;
+                j--;
+            }
+        }
+
+        if ((int32_t) k <= j) {
+            right = j;
+        } else if ((int32_t) k >= i) {
+            left = i;
+        } else {
+            break;
+        }
+    }
+
+#undef SWAP
+
+    return x[k];
+}
 
 char * util_canonize_callsign(const char * callsign, bool strip_slashes) {
     if (!callsign) {
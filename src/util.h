@@ -41,5 +41,6 @@ bool wrms_ready(wrms_t wr);
 float wrms_get_val(wrms_t wr);
 
 size_t argmax(float *x, size_t n);
+float select_nth(float *x, size_t n, size_t k);
 
 char *util_canonize_callsign(const char *callsign, bool strip_slashes);
@@ -18,14 +18,19 @@
 #include "dsp.h"
 #include "util.h"
 #include "pubsub_ids.h"
+#include "triple_buf.h"
+#include "wf_palette.h"
+#include "render.h"
 
 #include <stdlib.h>
 #include <math.h>
 #include <stdio.h>
+#include <string.h>
 
 #define PX_BYTES    sizeof(lv_color_t)
 #define DEFAULT_MIN S4
 #define DEFAULT_MAX S9_20
+#define FRAME_POLL_MS   5
 
 static lv_obj_t         *obj;
 static lv_obj_t         *img;
@@ -48,6 +53,14 @@ static uint8_t          delay = 0;
 static int64_t         *freq_offsets;
 static uint16_t         last_row_id;
 static uint8_t          *waterfall_cache;
+static int16_t          *mapping;
+
+/* State of the rendered frame, for incremental redraw */
+
+static uint16_t         new_rows = 0;
+static bool             frame_valid = false;
+static int64_t          frame_center_freq;
+static uint8_t          frame_zoom;
 
 static int64_t         radio_center_freq = 0;
 static int64_t         wf_center_freq = 0;
@@ -57,10 +70,20 @@ static uint8_t          refresh_counter = 0;
 
 static uint8_t          zoom = 1;
 
+/* PSD row from radio thread */
+
+typedef struct {
+    bool        tx;
+    float       data[WATERFALL_NFFT];
+} waterfall_frame_t;
+
+static triple_buf_t     frames;
+
 static void refresh_waterfall();
 static void draw_middle_line();
 static void redraw_cb(lv_event_t * e);
 static void zoom_changed_cd(void * s, lv_msg_t * m);
+static void frame_timer_cb(lv_timer_t *t);
 
 
 lv_obj_t * waterfall_init(lv_obj_t * parent, uint64_t cur_freq) {
@@ -80,23 +103,54 @@ lv_obj_t * waterfall_init(lv_obj_t * parent, uint64_t cur_freq) {
 
     lv_msg_subscribe(MSG_SPECTRUM_ZOOM_CHANGED, zoom_changed_cd, NULL);
 
+    frames = triple_buf_create(sizeof(waterfall_frame_t));
+
     return obj;
 }
 
 static void scroll_down() {
     last_row_id = (last_row_id + 1) % height;
+
+    if (new_rows < height) {
+        new_rows++;
+    }
 }
 
+/**
+ * Called from radio thread. Never blocks, older unread row is replaced
+ */
 void waterfall_data(float *data_buf, uint16_t size, bool tx) {
+    if (!frames) {
+        return;
+    }
+
+    waterfall_frame_t *frame = triple_buf_back(frames);
+
+    frame->tx = tx;
+    memcpy(frame->data, data_buf, size * sizeof(float));
+
+    triple_buf_publish(frames);
+}
+
+static void frame_timer_cb(lv_timer_t *t) {
+    if (!triple_buf_update(frames)) {
+        return;
+    }
+
     if (delay)
     {
         delay--;
         return;
     }
+    render_frame_begin(RENDER_WATERFALL);
     scroll_down();
 
+    waterfall_frame_t   *frame = triple_buf_front(frames);
+    float               *data_buf = frame->data;
+    uint16_t            size = WATERFALL_NFFT;
+
     float min, max;
-    if (tx) {
+    if (frame->tx) {
         min = DEFAULT_MIN;
         max = DEFAULT_MAX;
     } else {
@@ -106,19 +160,10 @@ void waterfall_data(float *data_buf, uint16_t size, bool tx) {
 
     freq_offsets[last_row_id] = radio_center_freq + params_lo_offset_get();
 
-    for (uint16_t x = 0; x < size; x++) {
-        float       v = (data_buf[x] - min) / (max - min);
+    wf_palette_row((lv_color_t *) waterfall_cache + last_row_id * size, data_buf, size, min, max, palette, 1, 255, true);
 
-        if (v < 0.0f) {
-            v = 0.0f;
-        } else if (v > 1.0f) {
-            v = 1.0f;
-        }
-
-        uint8_t id = v * 254 + 1;
-        memcpy(&waterfall_cache[(last_row_id * size + size - 1 - x) * PX_BYTES], &palette[id], PX_BYTES);
-    }
     refresh_waterfall();
+    render_frame(RENDER_WATERFALL);
 }
 
 static void do_scroll_cb(lv_event_t * event) {
@@ -130,7 +175,8 @@ static void do_scroll_cb(lv_event_t * event) {
     } else {
         wf_center_freq = radio_center_freq;
     }
-    refresh_waterfall();
+    /* Invalidation is not allowed while drawing, postpone it */
+    event_send(img, LV_EVENT_REFRESH, NULL);
 }
 
 void waterfall_set_height(lv_coord_t h) {
@@ -158,9 +204,14 @@ void waterfall_set_height(lv_coord_t h) {
     last_row_id = 0;
     waterfall_cache = malloc(WATERFALL_NFFT * height * PX_BYTES);
     memset(waterfall_cache, 0, WATERFALL_NFFT * height * PX_BYTES);
+    mapping = malloc(width * sizeof(*mapping));
+    frame_valid = false;
 
+    /* Measure from before redraw_cb, remapping of the rows is the most of the cost */
+    render_attach(RENDER_WATERFALL, img);
     lv_obj_add_event_cb(img, do_scroll_cb, LV_EVENT_DRAW_POST_END, NULL);
     lv_obj_add_event_cb(img, redraw_cb, LV_EVENT_DRAW_MAIN_BEGIN, NULL);
+    lv_timer_create(frame_timer_cb, FRAME_POLL_MS, NULL);
 
     waterfall_min_max_reset();
     band_info_init(obj);
@@ -245,47 +296,77 @@ void waterfall_refresh_period_set(uint8_t k) {
     refresh_period = k;
 }
 
-static void redraw_cb(lv_event_t * e) {
-    int32_t src_x_offset;
-    uint16_t src_y, src_x, dst_y, dst_x;
+static void update_mapping(uint8_t current_zoom) {
+    float rel_position;
 
-    uint8_t * temp_buf = frame->data;
+    for (uint16_t i = 0; i < width; i++) {
+        rel_position = (((float) i + 0.5) / width) - 0.5f;
+        mapping[i] = roundf(((rel_position / current_zoom) + 0.5f) * WATERFALL_NFFT - 1.0f);
+    }
+}
+
+/**
+ * Remap one cached row to the frame
+ */
+static void draw_row(uint16_t src_y, uint16_t dst_y) {
+    int32_t     src_x_offset = (freq_offsets[src_y] - wf_center_freq) * WATERFALL_NFFT / width_hz;
+    lv_color_t  *src = (lv_color_t *) waterfall_cache + src_y * WATERFALL_NFFT;
+    lv_color_t  *dst = (lv_color_t *) frame->data + dst_y * width;
+    lv_color_t  black = lv_color_black();
+
+    for (uint16_t dst_x = 0; dst_x < width; dst_x++) {
+        int32_t src_x = mapping[dst_x] - src_x_offset;
 
+        dst[dst_x] = (src_x < 0 || src_x >= WATERFALL_NFFT) ? black : src[src_x];
+    }
+}
+
+/**
+ * Newest row is at the top. While center and zoom are unchanged, the frame is
+ * scrolled down and only new rows are painted. Tune or zoom remaps the whole frame
+ */
+static void redraw_cb(lv_event_t * e) {
     uint8_t current_zoom = 1;
+
     if (params.waterfall_zoom.x) {
         current_zoom = zoom;
     }
 
-    lv_color_t black = lv_color_black();
-    lv_color_t * px_color;
+    uint16_t rows = new_rows;
 
-    int16_t mapping[width];
-    float rel_position;
-    for (uint16_t i = 0; i < width; i++) {
-        rel_position = (((float) i + 0.5) / width) - 0.5f;
-        mapping[i] = roundf(((rel_position / current_zoom) + 0.5f) * WATERFALL_NFFT - 1.0f);
+    if (!frame_valid || frame_zoom != current_zoom) {
+        update_mapping(current_zoom);
+        rows = height;
+    } else if (frame_center_freq != wf_center_freq) {
+        rows = height;
     }
 
-    for (src_y = 0; src_y < height; src_y++) {
-        dst_y = ((height - src_y + last_row_id) % height);
-        src_x_offset = (freq_offsets[src_y] - wf_center_freq) * WATERFALL_NFFT / width_hz;
-        for (dst_x = 0; dst_x < width; dst_x++) {
-            src_x = mapping[dst_x] - src_x_offset;
-            if ((src_x < 0) || (src_x >= WATERFALL_NFFT)) {
-                px_color = &black;
-            } else {
-                px_color = (lv_color_t*)waterfall_cache + (src_y * WATERFALL_NFFT + src_x);
-            }
-            *((lv_color_t*)temp_buf + (dst_y * width + dst_x)) = *px_color;
-        }
+    if (rows == 0) {
+        return;
     }
+
+    if (rows < height) {
+        memmove(frame->data + rows * width * PX_BYTES, frame->data, (height - rows) * width * PX_BYTES);
+    }
+
+    for (uint16_t dst_y = 0; dst_y < rows; dst_y++) {
+        draw_row((last_row_id + height - dst_y) % height, dst_y);
+    }
+
+    new_rows = 0;
+    frame_valid = true;
+    frame_center_freq = wf_center_freq;
+    frame_zoom = current_zoom;
 }
 
 static void refresh_waterfall() {
     refresh_counter++;
     if (refresh_counter >= refresh_period) {
         refresh_counter = 0;
-        event_send(img, LV_EVENT_REFRESH, NULL);
+
+        if (backlight_is_on()) {
+            lv_obj_invalidate(img);
+        }
     }
 }
 
@@ -0,0 +1,112 @@
+/*
+ *  SPDX-License-Identifier: LGPL-2.1-or-later
+ *
+ *  Xiegu X6100 LVGL GUI
+ *
+ *  Copyright (c) 2022-2023 Belousov Oleg aka R1CBU
+ */
+
+#include "wf_palette.h"
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#define CHUNK   256
+
+static size_t quantize_scalar(uint8_t *dst, const float *src, size_t n, float min, float k, float top, uint8_t lo) {
+    for (size_t i = 0; i < n; i++) {
+        float v = (src[i] - min) * k;
+
+        v = v < 0.0f ? 0.0f : v;
+        v = v > top ? top : v;
+
+        dst[i] = lo + (uint8_t) (int32_t) v;
+    }
+
+    return n;
+}
+
+#if defined(__ARM_NEON)
+
+static inline uint16x4_t quantize_4(const float *src, float32x4_t min, float32x4_t k, float32x4_t zero, float32x4_t top) {
+    float32x4_t v = vmulq_f32(vsubq_f32(vld1q_f32(src), min), k);
+
+    v = vminq_f32(vmaxq_f32(v, zero), top);
+
+    return vmovn_u32(vcvtq_u32_f32(v));
+}
+
+/**
+ * 16 bins per iteration, returns count of processed bins
+ */
+static size_t quantize_neon(uint8_t *dst, const float *src, size_t n, float min, float k, float top, uint8_t lo) {
+    float32x4_t v_min = vdupq_n_f32(min);
+    float32x4_t v_k = vdupq_n_f32(k);
+    float32x4_t v_zero = vdupq_n_f32(0.0f);
+    float32x4_t v_top = vdupq_n_f32(top);
+    uint8x16_t  v_lo = vdupq_n_u8(lo);
+    size_t      i;
+
+    for (i = 0; i + 16 <= n; i += 16) {
+        uint16x8_t  a = vcombine_u16(quantize_4(src + i, v_min, v_k, v_zero, v_top), quantize_4(src + i + 4, v_min, v_k, v_zero, v_top));
+        uint16x8_t  b = vcombine_u16(quantize_4(src + i + 8, v_min, v_k, v_zero, v_top), quantize_4(src + i + 12, v_min, v_k, v_zero, v_top));
+        uint8x16_t  r = vcombine_u8(vmovn_u16(a), vmovn_u16(b));
+
+        vst1q_u8(dst + i, vaddq_u8(r, v_lo));
+    }
+
+    return i;
+}
+
+#endif
+
+/**
+ * Reference version, for benchmark and self check
+ */
+void wf_quantize_scalar(uint8_t *dst, const float *src, size_t n, float min, float max, uint8_t lo, uint8_t hi) {
+    float top = hi - lo;
+
+    quantize_scalar(dst, src, n, min, top / (max - min), top, lo);
+}
+
+void wf_quantize(uint8_t *dst, const float *src, size_t n, float min, float max, uint8_t lo, uint8_t hi) {
+    float   top = hi - lo;
+    float   k = top / (max - min);
+    size_t  done = 0;
+
+#if defined(__ARM_NEON)
+    done = quantize_neon(dst, src, n, min, k, top, lo);
+#endif
+
+    quantize_scalar(dst + done, src + done, n - done, min, k, top, lo);
+}
+
+/**
+ * Convert row of dB values to colors. With reverse, the last value goes to dst[0]
+ */
+void wf_palette_row(lv_color_t *dst, const float *src, size_t n, float min, float max,
+                    const lv_color_t *palette, uint8_t lo, uint8_t hi, bool reverse)
+{
+    uint8_t ids[CHUNK];
+
+    for (size_t pos = 0; pos < n; pos += CHUNK) {
+        size_t len = n - pos < CHUNK ? n - pos : CHUNK;
+
+        wf_quantize(ids, src + pos, len, min, max, lo, hi);
+
+        if (reverse) {
+            lv_color_t *out = dst + n - 1 - pos;
+
+            for (size_t i = 0; i < len; i++) {
+                *out-- = palette[ids[i]];
+            }
+        } else {
+            lv_color_t *out = dst + pos;
+
+            for (size_t i = 0; i < len; i++) {
+                out[i] = palette[ids[i]];
+            }
+        }
+    }
+}
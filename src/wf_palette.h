@@ -0,0 +1,23 @@
+/*
+ *  SPDX-License-Identifier: LGPL-2.1-or-later
+ *
+ *  Xiegu X6100 LVGL GUI
+ *
+ *  Copyright (c) 2022-2023 Belousov Oleg aka R1CBU
+ */
+
+#pragma once
+
+#include "lvgl/lvgl.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Waterfall row kernel: normalize dB values to [min, max], quantize to palette index [lo, hi], lookup color */
+
+void wf_quantize(uint8_t *dst, const float *src, size_t n, float min, float max, uint8_t lo, uint8_t hi);
+void wf_quantize_scalar(uint8_t *dst, const float *src, size_t n, float min, float max, uint8_t lo, uint8_t hi);
+
+void wf_palette_row(lv_color_t *dst, const float *src, size_t n, float min, float max,
+                    const lv_color_t *palette, uint8_t lo, uint8_t hi, bool reverse);
@@ -9,18 +9,23 @@
  *********************/
 
 #include "lv_waterfall.h"
+#include "../wf_palette.h"
 
 /*********************
  *      DEFINES
  *********************/
 #define MY_CLASS &lv_waterfall_class
 
+#define ROWS_POLL_MS    5
+
 /**********************
  *  STATIC PROTOTYPES
  **********************/
 
 static void lv_waterfall_constructor(const lv_obj_class_t * class_p, lv_obj_t * obj);
 static void lv_waterfall_destructor(const lv_obj_class_t * class_p, lv_obj_t * obj);
+static void lv_waterfall_event(const lv_obj_class_t * class_p, lv_event_t * e);
+static void rows_timer_cb(lv_timer_t * t);
 
 /**********************
  *  STATIC VARIABLES
@@ -29,6 +34,7 @@ static void lv_waterfall_destructor(const lv_obj_class_t * class_p, lv_obj_t * o
 const lv_obj_class_t lv_waterfall_class  = {
     .constructor_cb = lv_waterfall_constructor,
     .destructor_cb = lv_waterfall_destructor,
+    .event_cb = lv_waterfall_event,
     .base_class = &lv_img_class,
     .instance_size = sizeof(lv_waterfall_t),
 };
@@ -73,6 +79,14 @@ void lv_waterfall_set_size(lv_obj_t * obj, lv_coord_t w, lv_coord_t h) {
 
     waterfall->line_len = waterfall->dsc->data_size / waterfall->dsc->header.h;
     waterfall->line_buf = lv_mem_realloc(waterfall->line_buf, waterfall->line_len);
+    waterfall->line_buf_size = waterfall->line_len;
+    waterfall->head = 0;
+
+    if (waterfall->rows) {
+        triple_buf_destroy(waterfall->rows);
+    }
+
+    waterfall->rows = triple_buf_create(waterfall->line_len);
 
     lv_img_set_src(obj, waterfall->dsc);
     lv_img_cache_invalidate_src(waterfall->dsc);
@@ -84,46 +98,53 @@ void lv_waterfall_clear_data(lv_obj_t * obj) {
     lv_waterfall_t * waterfall = (lv_waterfall_t *)obj;
 
     memset(waterfall->dsc->data, 0, waterfall->dsc->data_size);
+    waterfall->head = 0;
+
+    /* Drop the row painted before */
+
+    if (waterfall->rows) {
+        triple_buf_update(waterfall->rows);
+    }
+
     lv_img_cache_invalidate_src(waterfall->dsc);
 }
 
+/**
+ * Paint the row and publish it. Never blocks, older row not taken by LVGL yet is replaced
+ */
 void lv_waterfall_add_data(lv_obj_t * obj, float * data, uint16_t cnt) {
     LV_ASSERT_OBJ(obj, MY_CLASS);
 
     lv_waterfall_t  *waterfall = (lv_waterfall_t *)obj;
     lv_img_dsc_t    *dsc = waterfall->dsc;
 
-    if (!dsc || !waterfall->palette) {
+    if (!dsc || !waterfall->palette || !waterfall->rows) {
         return;
     }
 
-    uint32_t        line_len = waterfall->line_len;
-    uint8_t         *ptr = dsc->data + dsc->data_size - line_len * 2;
-
-    /* Scroll down */
+    lv_color_t  *row = triple_buf_back(waterfall->rows);
+    uint8_t     hi = waterfall->palette_cnt - 1;
 
-    for (uint16_t y = 0; y < dsc->header.h - 1; y++) {
-        memcpy(ptr + line_len, ptr, line_len);
-        ptr -= line_len;
+    if (cnt == dsc->header.w) {
+        wf_palette_row(row, data, cnt, waterfall->min, waterfall->max, waterfall->palette, 0, hi, false);
+        triple_buf_publish(waterfall->rows);
+        return;
     }
 
-    /* Paint */
+    if (cnt > waterfall->line_buf_size) {
+        waterfall->line_buf = lv_mem_realloc(waterfall->line_buf, cnt);
+        waterfall->line_buf_size = cnt;
+    }
 
-    for (uint32_t x = 0; x < dsc->header.w; x++) {
-        uint32_t    index = x * cnt / dsc->header.w;
-        float       d = data[index];
-        float       v = (d - waterfall->min) / (waterfall->max - waterfall->min);
-
-        if (v < 0.0f) {
-            v = 0.0f;
-        } else if (v > 1.0f) {
-            v = 1.0f;
-        }
+    uint8_t *ids = waterfall->line_buf;
 
-        uint8_t id = v * 255;
+    wf_quantize(ids, data, cnt, waterfall->min, waterfall->max, 0, hi);
 
-        lv_img_buf_set_px_color(dsc, x, 0, waterfall->palette[id]);
+    for (uint32_t x = 0; x < dsc->header.w; x++) {
+        row[x] = waterfall->palette[ids[x * cnt / dsc->header.w]];
     }
+
+    triple_buf_publish(waterfall->rows);
 }
 
 void lv_waterfall_set_min(lv_obj_t * obj, int16_t val) {
@@ -151,8 +172,12 @@ static void lv_waterfall_constructor(const lv_obj_class_t * class_p, lv_obj_t *
     waterfall->palette_cnt = 0;
     waterfall->line_len = 0;
     waterfall->line_buf = NULL;
+    waterfall->line_buf_size = 0;
+    waterfall->head = 0;
+    waterfall->rows = NULL;
     waterfall->min = -40;
     waterfall->max = 0;
+    waterfall->timer = lv_timer_create(rows_timer_cb, ROWS_POLL_MS, obj);
 
     LV_TRACE_OBJ_CREATE("finished");
 }
@@ -161,6 +186,129 @@ static void lv_waterfall_destructor(const lv_obj_class_t * class_p, lv_obj_t * o
     LV_UNUSED(class_p);
     lv_waterfall_t * waterfall = (lv_waterfall_t *)obj;
 
+    lv_timer_del(waterfall->timer);
+
     if (waterfall->palette) lv_mem_free(waterfall->palette);
     if (waterfall->line_buf) lv_mem_free(waterfall->line_buf);
+    if (waterfall->rows) triple_buf_destroy(waterfall->rows);
+}
+
+/**
+ * Scroll down: the newest published row goes before the head of the ring
+ */
+static void rows_timer_cb(lv_timer_t * t) {
+    lv_obj_t        *obj = t->user_data;
+    lv_waterfall_t  *waterfall = (lv_waterfall_t *)obj;
+    lv_img_dsc_t    *dsc = waterfall->dsc;
+
+    if (!dsc || !waterfall->rows || !triple_buf_update(waterfall->rows)) {
+        return;
+    }
+
+    uint16_t head = waterfall->head ? waterfall->head - 1 : dsc->header.h - 1;
+
+    memcpy((uint8_t *) dsc->data + head * waterfall->line_len, triple_buf_front(waterfall->rows), waterfall->line_len);
+    waterfall->head = head;
+
+    lv_obj_invalidate(obj);
+}
+
+/**
+ * Zoom and angle would need the ring parts drawn as one transformed image, reset them
+ */
+static void reject_transform(lv_obj_t * obj) {
+    lv_img_t * img = (lv_img_t *)obj;
+
+    if (img->zoom != LV_IMG_ZOOM_NONE || img->angle != 0) {
+        LV_LOG_WARN("zoom and angle are not supported");
+        img->zoom = LV_IMG_ZOOM_NONE;
+        img->angle = 0;
+    }
+}
+
+/**
+ * Rows are a ring with the newest one at head. Draw it as two images in the content area:
+ * head..end at the top, then 0..head
+ */
+static void draw_rows(lv_event_t * e) {
+    lv_obj_t        *obj = lv_event_get_target(e);
+    lv_waterfall_t  *waterfall = (lv_waterfall_t *)obj;
+    lv_img_dsc_t    *dsc = waterfall->dsc;
+
+    if (!dsc) {
+        return;
+    }
+
+    lv_draw_ctx_t       *draw_ctx = lv_event_get_draw_ctx(e);
+    lv_draw_img_dsc_t   img_dsc;
+    lv_area_t           content;
+    lv_area_t           clip_area;
+
+    lv_obj_get_content_coords(obj, &content);
+
+    if (!_lv_area_intersect(&clip_area, draw_ctx->clip_area, &content)) {
+        return;
+    }
+
+    lv_draw_img_dsc_init(&img_dsc);
+    lv_obj_init_draw_img_dsc(obj, LV_PART_MAIN, &img_dsc);
+
+    const lv_area_t *clip_area_ori = draw_ctx->clip_area;
+
+    draw_ctx->clip_area = &clip_area;
+
+    uint16_t        h = dsc->header.h;
+    uint16_t        head = waterfall->head;
+    lv_coord_t      y = content.y1;
+
+    for (uint8_t i = 0; i < 2; i++) {
+        uint16_t    first = i == 0 ? head : 0;
+        uint16_t    rows = i == 0 ? h - head : head;
+
+        if (rows == 0) {
+            continue;
+        }
+
+        lv_img_dsc_t    part = *dsc;
+        lv_area_t       area;
+
+        part.header.h = rows;
+        part.data = dsc->data + first * waterfall->line_len;
+        part.data_size = rows * waterfall->line_len;
+
+        area.x1 = content.x1;
+        area.y1 = y;
+        area.x2 = area.x1 + dsc->header.w - 1;
+        area.y2 = area.y1 + rows - 1;
+
+        lv_img_cache_invalidate_src(&part);
+        lv_draw_img(draw_ctx, &img_dsc, &area, &part);
+
+        y += rows;
+    }
+
+    draw_ctx->clip_area = clip_area_ori;
+}
+
+static void lv_waterfall_event(const lv_obj_class_t * class_p, lv_event_t * e) {
+    LV_UNUSED(class_p);
+
+    lv_event_code_t code = lv_event_get_code(e);
+
+    /* Image setters and transform styles refresh the extra draw size */
+
+    if (code == LV_EVENT_REFR_EXT_DRAW_SIZE) {
+        reject_transform(lv_event_get_target(e));
+    }
+
+    /* Replaces image drawing of the base class, background and border are drawn by lv_obj */
+
+    if (code == LV_EVENT_DRAW_MAIN) {
+        if (lv_obj_event_base(&lv_img_class, e) == LV_RES_OK) {
+            draw_rows(e);
+        }
+        return;
+    }
+
+    lv_obj_event_base(MY_CLASS, e);
 }
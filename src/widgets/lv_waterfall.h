@@ -16,6 +16,7 @@ extern "C" {
  *********************/
 
 #include "lvgl/lvgl.h"
+#include "../triple_buf.h"
 
 /**********************
  *      TYPEDEFS
@@ -26,7 +27,12 @@ typedef struct {
     lv_img_dsc_t    *dsc;
 
     uint32_t        line_len;
-    uint8_t         *line_buf;
+    uint8_t         *line_buf;      /* Producer side */
+    uint32_t        line_buf_size;
+    uint16_t        head;           /* LVGL side */
+
+    triple_buf_t    rows;           /* Newest painted row, from producer to LVGL */
+    lv_timer_t      *timer;
 
     lv_color_t      *palette;
     uint16_t        palette_cnt;
@@ -47,6 +53,13 @@ lv_obj_t * lv_waterfall_create(lv_obj_t * parent);
  * Setter functions
  *====================*/
 
+/*
+ * lv_waterfall_add_data() may be called from another thread: it paints the row
+ * and publishes it, LVGL timer puts the newest one into the image. Other functions
+ * are LVGL thread only, set size before adding data. Zoom and angle of the image
+ * are not supported and reset with a warning, transform styles are ignored.
+ */
+
 void lv_waterfall_set_palette(lv_obj_t * obj, lv_color_t * palette, uint16_t cnt);
 void lv_waterfall_set_size(lv_obj_t * obj, lv_coord_t w, lv_coord_t h);
 